@@ -1,20 +1,45 @@
 #ifndef IMAGE_PROCESSING_H
 #define IMAGE_PROCESSING_H
 
+#include <stddef.h> /* size_t */
+
 typedef struct image {
-  int height;           /* height in pixels */
-  int width;            /* width in pixels */
+  size_t height;        /* height in pixels */
+  size_t width;         /* width in pixels */
   unsigned char *data;  /* height * width pixels, row major order */
 } image;
 
+typedef struct image16 {
+  size_t height;        /* height in pixels */
+  size_t width;         /* width in pixels */
+  int bit_depth;        /* significant bits per pixel (1 - 16), e.g. 10, 12 or 16 */
+  unsigned short *data; /* height * width pixels, row major order */
+} image16;
+
+/* precomputed weight tables for one resize size pair and filter */
+typedef struct image_resize_plan image_resize_plan;
+
+/* state kept between frames by image_he_stream_frame */
+typedef struct image_he_stream image_he_stream;
+
 typedef enum Image_Result {
 	Image_Success,
 	Image_Uninitialized_Error,
   Image_Allocation_Error,
   Image_Size_Error,
 	Image_KernelSize_Error,
+  Image_BitDepth_Error,
+  Image_Filter_Error,
 } Image_Result;
 
+typedef enum Image_Filter {
+  Image_Filter_Nearest,
+  Image_Filter_Bilinear,
+  Image_Filter_Bicubic,
+  Image_Filter_Area,
+  Image_Filter_Lanczos3,
+} Image_Filter;
+
 /**
  * @brief Performs convolution on @src, using @kernel, and writes the result to @dst.
  * 
@@ -26,8 +51,8 @@ typedef enum Image_Result {
  * @return success or error code
  * @return Image_Success on success
  * @return Image_Uninitialized_Error if input @dst, @src or @kernel are not initialized
- * @return Image_Size_Error if input @dst and @src have different dimensions
- * @return Image_KernelSize_Error if input @kernel_size is equal to zero or even size
+ * @return Image_Size_Error if input @dst and @src have different dimensions, or height * width overflows
+ * @return Image_KernelSize_Error if input @kernel_size is equal to zero, even size or larger than @src
 **/
 Image_Result image_convolution(struct image *dst, const struct image *src, const double *kernel, int kernel_size);
 
@@ -43,7 +68,7 @@ Image_Result image_convolution(struct image *dst, const struct image *src, const
  * @return Image_Success on success
  * @return Image_Uninitialized_Error if input @dst or @src are not initialized
  * @return Image_Allocation_Error if comulative distribution table's allocation failed
- * @return Image_Size_Error if input @dst and @src have different dimensions
+ * @return Image_Size_Error if input @dst and @src have different dimensions, or height * width overflows
 **/
 Image_Result image_he(struct image *dst, const struct image *src);
 
@@ -58,7 +83,165 @@ Image_Result image_he(struct image *dst, const struct image *src);
  * @return success or error code
  * @return Image_Success on success
  * @return Image_Uninitialized_Error if input @img is not initialized
+ * @return Image_Size_Error if input @img is empty, or height * width overflows
 **/
 Image_Result image_find_min_max(const struct image *img, unsigned char *min, unsigned char *max);
 
+
+/**
+ * @brief Performs convolution on high bit depth @src, using @kernel, and writes the result to @dst.
+ *        Results are clamped to [0, 2^@dst->bit_depth - 1].
+ * 
+ * @param[in] src - source image (must have same dimensios and bit depth as @dst)
+ * @param[in] kernel - kernel for convolution (squre, with odd dimensions, row major order)
+ * @param[in] kernel_size - size of the kernel.
+ * @param[out] dst - destination image (must have same dimensios and bit depth as @src)
+ *
+ * @return success or error code
+ * @return Image_Success on success
+ * @return Image_Uninitialized_Error if input @dst, @src or @kernel are not initialized
+ * @return Image_Size_Error if input @dst and @src have different dimensions, or height * width overflows
+ * @return Image_KernelSize_Error if input @kernel_size is equal to zero, even size or larger than @src
+ * @return Image_BitDepth_Error if bit depths differ or are out of range (1 - 16)
+**/
+Image_Result image16_convolution(struct image16 *dst, const struct image16 *src, const double *kernel, int kernel_size);
+
+
+/**
+ * @brief This function equalization high bit depth @src's histogram. It then applies the
+ *        equalized histogram to @src and writes the modified image, spread over
+ *        [0, 2^@dst->bit_depth - 1], to @dst.
+ *        The histogram covers only @src's min..max range and is counted in two levels
+ *        (high byte, then low byte), so only 256-entry blocks that hold pixels are allocated.
+ * 
+ * @param[in] src - source image (must have same dimensios and bit depth as @dst)
+ * @param[out] dst - destination image (must have same dimensios and bit depth as @src)
+ *
+ * @return success or error code
+ * @return Image_Success on success
+ * @return Image_Uninitialized_Error if input @dst or @src are not initialized
+ * @return Image_Allocation_Error if comulative distribution or per chunk counting tables' allocation failed
+ * @return Image_Size_Error if input @dst and @src have different dimensions, or height * width overflows
+ * @return Image_BitDepth_Error if bit depths differ or are out of range (1 - 16)
+**/
+Image_Result image16_he(struct image16 *dst, const struct image16 *src);
+
+
+/**
+ * @brief This function finds high bit depth @img's minimum and maximum pixel values.
+ * 
+ * @param[in] img - image to be analyzed
+ * @param[out] min - minimum pixel value in @img
+ * @param[out] max - maximum pixel value in @img
+ *
+ * @return success or error code
+ * @return Image_Success on success
+ * @return Image_Uninitialized_Error if input @img is not initialized
+ * @return Image_Size_Error if input @img is empty, or height * width overflows
+**/
+Image_Result image16_find_min_max(const struct image16 *img, unsigned short *min, unsigned short *max);
+
+
+/**
+ * @brief Creates a histogram equalization state for a sequence of frames (video).
+ * 
+ * @param[in] smoothing - weight (0 <= @smoothing < 1) of the previous frames' CDF in the new one,
+ *                        0 disables temporal smoothing
+ * @param[in] threshold - L1 distance between normalized histograms (0 - 2) up to which the
+ *                        cached lookup table is reused, 0 rebuilds it on every changed frame
+ *
+ * @return pointer to the new state, or NULL if arguments are out of range or allocation failed
+**/
+image_he_stream* image_he_stream_create(double smoothing, double threshold);
+
+
+/**
+ * @brief Destroys a state created by image_he_stream_create and sets *@stream to NULL.
+ * 
+ * @param[in,out] stream - state to be destroyed
+**/
+void image_he_stream_destroy(image_he_stream **stream);
+
+
+/**
+ * @brief Equalizes the next frame @src of a sequence and writes the result to @dst.
+ *        The CDF is blended with the previous frames' CDF to prevent flicker, and keeps
+ *        being blended on every frame until it is within half an output level of the
+ *        frame's CDF. Once settled, and while @src's histogram is within @stream's
+ *        threshold of the one the current lookup table was built from, the table is
+ *        reused and only applied to @src.
+ *        The cached table is applied in the same pass that counts @src, so reusing it
+ *        costs one pass over the frame. In place frames (@dst == @src) are counted first
+ *        and then applied.
+ * 
+ * @param[in,out] stream - state of the sequence
+ * @param[in] src - source frame (must have same dimensios as @dst)
+ * @param[out] dst - destination frame (must have same dimensios as @src)
+ *
+ * @return success or error code
+ * @return Image_Success on success
+ * @return Image_Uninitialized_Error if input @stream, @dst or @src are not initialized
+ * @return Image_Size_Error if input @dst and @src have different dimensions, or height * width overflows
+**/
+Image_Result image_he_stream_frame(image_he_stream *stream, struct image *dst, const struct image *src);
+
+
+/**
+ * @brief Resizes @src to @dst's dimensions using @filter.
+ *        Builds the weight tables for this size pair on every call, use
+ *        image_resize_plan_create and image_resize_with_plan to reuse them.
+ * 
+ * @param[in] src - source image
+ * @param[in] filter - resampling filter
+ * @param[out] dst - destination image, its height and width set the new size
+ *
+ * @return success or error code
+ * @return Image_Success on success
+ * @return Image_Uninitialized_Error if input @dst or @src are not initialized
+ * @return Image_Allocation_Error if weight tables' or row buffers' allocation failed,
+ *         or a downscale needs more taps than the weights' precision can represent
+ * @return Image_Size_Error if input @dst or @src has zero size, or height * width overflows
+ * @return Image_Filter_Error if input @filter is unknown
+**/
+Image_Result image_resize(struct image *dst, const struct image *src, Image_Filter filter);
+
+
+/**
+ * @brief Precomputes separable fixed point weight tables for resizing images of
+ *        @src_height x @src_width to @dst_height x @dst_width using @filter.
+ * 
+ * @param[in] dst_height, dst_width - destination dimensions
+ * @param[in] src_height, src_width - source dimensions
+ * @param[in] filter - resampling filter
+ *
+ * @return pointer to the new plan, or NULL if arguments are invalid, allocation failed,
+ *         or a downscale needs more than 1 << 22 taps per output pixel
+**/
+image_resize_plan* image_resize_plan_create(size_t dst_height, size_t dst_width, size_t src_height, size_t src_width, Image_Filter filter);
+
+
+/**
+ * @brief Destroys a plan created by image_resize_plan_create and sets *@plan to NULL.
+ * 
+ * @param[in,out] plan - plan to be destroyed
+**/
+void image_resize_plan_destroy(image_resize_plan **plan);
+
+
+/**
+ * @brief Resizes @src to @dst using the weight tables in @plan. The plan is only read,
+ *        so it can be shared between calls and threads.
+ * 
+ * @param[in] plan - plan built for @dst's and @src's dimensions
+ * @param[in] src - source image
+ * @param[out] dst - destination image
+ *
+ * @return success or error code
+ * @return Image_Success on success
+ * @return Image_Uninitialized_Error if input @plan, @dst or @src are not initialized
+ * @return Image_Allocation_Error if row buffers' allocation failed
+ * @return Image_Size_Error if @dst's or @src's dimensions differ from @plan's
+**/
+Image_Result image_resize_with_plan(struct image *dst, const struct image *src, const image_resize_plan *plan);
+
 #endif /* IMAGE_PROCESSING_H */
\ No newline at end of file
@@ -1,12 +1,46 @@
 #include "image_processing.h"
 #include <stdio.h>
 #include <stdlib.h> /* malloc, free */
-#include <limits.h> /* UCHAR_MAX */
+#include <stddef.h> /* ptrdiff_t */
+#include <stdint.h> /* SIZE_MAX */
+#include <string.h> /* memcpy */
+#include <limits.h> /* UCHAR_MAX, SHRT_MAX */
 #include <math.h>   /* round */
+#ifdef __SSE2__
+#include <emmintrin.h> /* resize multiply-add kernels */
+#endif
 
 
 #define CENTRAL_KERNEL_INDEX(size) ((size)*((size)/2) + ((size)/2))
 #define IMAGE_MATRIX_SIZE(image) ((image)->height * (image)->width)
+#define SIZE_MUL_OVERFLOWS(first, second) (0 != (second) && (first) > SIZE_MAX / (second))
+#define IMAGE_MATRIX_OVERFLOWS(image) SIZE_MUL_OVERFLOWS((image)->height, (image)->width)
+
+/* pixel loops run over fixed size chunks, in parallel when built with OpenMP */
+#define IMAGE_CHUNK_PIXELS ((size_t)1 << 22)
+#define IMAGE_CHUNK_COUNT(size) ((size) / IMAGE_CHUNK_PIXELS + (0 != (size) % IMAGE_CHUNK_PIXELS))
+#define IMAGE_CHUNK_LENGTH(chunk, size) ((size) - (chunk) * IMAGE_CHUNK_PIXELS < IMAGE_CHUNK_PIXELS ? (size) - (chunk) * IMAGE_CHUNK_PIXELS : IMAGE_CHUNK_PIXELS)
+#define IMAGE16_MAX_VALUE(image) ((1UL << (image)->bit_depth) - 1)
+
+/* two-level histogram: high byte selects a block, low byte the bin inside it */
+#define HE_BLOCK_BITS 8
+#define HE_BLOCK_SIZE (1UL << HE_BLOCK_BITS)
+#define HE_BLOCK_MASK (HE_BLOCK_SIZE - 1)
+
+#define HE_STREAM_TABLE_SIZE (UCHAR_MAX + 1)
+/* the smoothed CDF snaps to the frame's once it lags by at most half an output level */
+#define HE_STREAM_SETTLED 0.5
+
+/* resize weights are fixed point shorts, each axis' summing to 1 << its precision.
+   22 bits at most keep 255 times the overshooting lanczos/bicubic weights within an int */
+#define RESIZE_PRECISION_BITS 22
+#ifdef __SSE2__
+#define RESIZE_HORIZONTAL_TAP_MULTIPLE 4
+#else
+#define RESIZE_HORIZONTAL_TAP_MULTIPLE 1
+#endif
+#define RESIZE_PI 3.14159265358979323846
+#define RESIZE_CHUNK_ROWS 256
 
 #define CHECK_MIN_MAX(value, min, max) \
   if (value < min) {                   \
@@ -17,17 +51,138 @@
   }
 
 
+/* pixel loops shared by image and image16, instantiated once per pixel type */
+#define DEFINE_PIXEL_CONVOLUTION_CENTER(name, image_type)                                            \
+  static double name(const image_type *img, const double *kernel, int kernel_size, size_t image_index, double max_value) { \
+    double retval = 0;                                                                               \
+    ptrdiff_t current_image_index;                                                                   \
+    size_t current_kernel_index;                                                                     \
+    int i, j;                                                                                        \
+    for (i = -(kernel_size / 2) ; i <= kernel_size / 2 ; ++i) {                                      \
+      for (j = -(kernel_size / 2) ; j <= kernel_size / 2 ; ++j) {                                    \
+        current_image_index = (ptrdiff_t)image_index + i * (ptrdiff_t)img->width + j;                \
+        current_kernel_index = CENTRAL_KERNEL_INDEX(kernel_size) - (i * kernel_size) - j;            \
+        retval += img->data[current_image_index] * kernel[current_kernel_index];                     \
+      }                                                                                              \
+    }                                                                                                \
+    return retval > max_value ? max_value : retval < 0 ? 0 : retval;                                 \
+  }
+
+/* not include corners */
+#define DEFINE_PIXEL_EXTEND_TOP_BOTTOM_SIDES(name, image_type)                                       \
+  static void name(image_type *dst, int kernel_size, size_t first_row, size_t last_row, size_t first_in_row_to_extend) { \
+    size_t row, col;                                                                                 \
+    for (row = first_row ; row < last_row ; ++row) {                                                 \
+      for (col = kernel_size/2 ; col < dst->width - kernel_size/2 ; ++col) {                         \
+        dst->data[row * dst->width + col] = dst->data[first_in_row_to_extend + col];                 \
+      }                                                                                              \
+    }                                                                                                \
+  }
+
+/* include corners */
+#define DEFINE_PIXEL_EXTEND_RIGHT_LEFT_SIDES(name, image_type)                                       \
+  static void name(image_type *dst, size_t first_col, size_t last_col, size_t first_in_col_to_extend) { \
+    size_t row, col;                                                                                 \
+    for (row = 0 ; row < dst->height ; ++row) {                                                      \
+      for (col = first_col ; col < last_col ; ++col) {                                               \
+        dst->data[row * dst->width + col] = dst->data[row * dst->width + first_in_col_to_extend];    \
+      }                                                                                              \
+    }                                                                                                \
+  }
+
+#define DEFINE_PIXELS_FIND_MIN_MAX(name, pixel_type)                                                 \
+  static void name(const pixel_type *data, size_t size, pixel_type *min, pixel_type *max) {          \
+    size_t i = 1;                                                                                    \
+    *min = data[0];                                                                                  \
+    *max = data[0];                                                                                  \
+    for ( ; i + 3 < size ; i += 4) {                                                                 \
+      CHECK_MIN_MAX(data[i], *min, *max)                                                             \
+      CHECK_MIN_MAX(data[i+1], *min, *max)                                                           \
+      CHECK_MIN_MAX(data[i+2], *min, *max)                                                           \
+      CHECK_MIN_MAX(data[i+3], *min, *max)                                                           \
+    }                                                                                                \
+    /* check for last elements */                                                                    \
+    for ( ; i < size ; ++i) {                                                                        \
+      CHECK_MIN_MAX(data[i], *min, *max)                                                             \
+    }                                                                                                \
+  }
+
+
+struct image_he_stream {
+  double smoothing;                                 /* weight of previous CDF */
+  double threshold;                                 /* max L1 distance for reusing lut */
+  size_t image_size;                                /* pixels in frame lut was built from, 0 before first frame */
+  size_t histogram[HE_STREAM_TABLE_SIZE];           /* histogram lut was built from */
+  size_t frame_histogram[HE_STREAM_TABLE_SIZE];     /* current frame histogram */
+  double cdf[HE_STREAM_TABLE_SIZE];                 /* smoothed CDF, in output levels */
+  double lag;                                       /* max |smoothed - frame CDF| at the last update */
+  unsigned char lut[HE_STREAM_TABLE_SIZE];
+};
+
+
+typedef struct resize_axis {
+  size_t *first;    /* first source index, per destination index */
+  short *weights;   /* taps fixed point weights, per destination index */
+  size_t taps;      /* source indices per destination index, windows are zero padded to it */
+  int precision;    /* fraction bits of weights */
+} resize_axis;
+
+struct image_resize_plan {
+  size_t dst_height;
+  size_t dst_width;
+  size_t src_height;
+  size_t src_width;
+  resize_axis horizontal;
+  resize_axis vertical;
+};
+
+
 static Image_Result convolution_validation_checking(const image *dst, const image *src, const double *kernel, int kernel_size);
 static int image_size_compare(const image *first, const image *second);
-static double pixel_convolution_center(const image *img, const double *kernel, int kernel_size, size_t image_index);
-static void pixel_extend_right_left_sides(image *dst, int kernel_size, int first_col, int last_col, int first_in_col_to_extend);
-static void pixel_extend_top_bottom_sides(image *dst, int kernel_size, int first_row, int last_row, int first_in_row_to_extend);
+static Image_Result image_matrix_checking(const image *img);
+static double pixel_convolution_center(const image *img, const double *kernel, int kernel_size, size_t image_index, double max_value);
+static void pixel_extend_right_left_sides(image *dst, size_t first_col, size_t last_col, size_t first_in_col_to_extend);
+static void pixel_extend_top_bottom_sides(image *dst, int kernel_size, size_t first_row, size_t last_row, size_t first_in_row_to_extend);
+static void pixels_find_min_max(const unsigned char *data, size_t size, unsigned char *min, unsigned char *max);
 
-static void image_intensity_counting(size_t *intensity_table, const image *src, size_t table_size, unsigned char min);
+static void image_intensity_counting(size_t *intensity_table, size_t table_size, const image *src, unsigned char min);
+static void pixels_intensity_counting(size_t *intensity_table, const unsigned char *data, size_t size, unsigned char min);
 static void image_cumulative_distribution(size_t *intensity_table, size_t table_size);
-static void image_histogram_equalization(size_t *intensity_table, const image *src, size_t table_size);
+static void image_histogram_equalization(size_t *intensity_table, size_t table_size, size_t image_size, size_t max_value);
 static void image_dst_populate(image *dst, const image *src, size_t *intensity_table, unsigned char min);
 
+static double he_stream_histogram_distance(const image_he_stream *stream, size_t image_size);
+static void he_stream_lut_update(image_he_stream *stream, size_t image_size);
+static void image_lut_apply(image *dst, const image *src, const unsigned char *lut);
+static void pixels_lut_apply(unsigned char *dst, const unsigned char *src, size_t size, const unsigned char *lut);
+static void image_lut_apply_counting(size_t *intensity_table, image *dst, const image *src, const unsigned char *lut);
+static void pixels_lut_apply_counting(size_t *intensity_table, unsigned char *dst, const unsigned char *src, size_t size, const unsigned char *lut);
+
+static double resize_filter_support(Image_Filter filter);
+static double resize_filter_weight(Image_Filter filter, double x);
+static int resize_axis_create(resize_axis *axis, size_t dst_size, size_t src_size, Image_Filter filter, size_t tap_multiple);
+static void resize_axis_destroy(resize_axis *axis);
+static unsigned char resize_clip(int value, int precision);
+static Image_Result resize_rows(image *dst, const image *src, const image_resize_plan *plan, size_t first_row, size_t last_row);
+static void resize_horizontal_row(unsigned char *dst_row, const unsigned char *src_row, const resize_axis *axis, size_t dst_width);
+static void resize_vertical_row(unsigned char *dst_row, const unsigned char **ring_window, const resize_axis *axis, size_t row, size_t dst_width);
+#ifdef __SSE2__
+static __m128i resize_load_quads(const unsigned char *first, const unsigned char *second);
+#endif
+
+static Image_Result image16_validation_checking(const image16 *dst, const image16 *src);
+static double pixel16_convolution_center(const image16 *img, const double *kernel, int kernel_size, size_t image_index, double max_value);
+static void pixel16_extend_right_left_sides(image16 *dst, size_t first_col, size_t last_col, size_t first_in_col_to_extend);
+static void pixel16_extend_top_bottom_sides(image16 *dst, int kernel_size, size_t first_row, size_t last_row, size_t first_in_row_to_extend);
+static void pixels16_find_min_max(const unsigned short *data, size_t size, unsigned short *min, unsigned short *max);
+
+static void image16_block_counting(size_t *block_table, size_t block_table_size, const image16 *src, unsigned short min);
+static void pixels16_block_counting(size_t *block_table, const unsigned short *data, size_t size, unsigned short min);
+static size_t image16_block_indexing(size_t *block_table, size_t block_table_size);
+static Image_Result image16_intensity_counting(size_t *intensity_table, size_t intensity_table_size, const size_t *block_table, const image16 *src, unsigned short min);
+static void pixels16_intensity_counting(size_t *intensity_table, const size_t *block_table, const unsigned short *data, size_t size, unsigned short min);
+static void image16_dst_populate(image16 *dst, const image16 *src, const size_t *intensity_table, const size_t *block_table, unsigned short min);
+
 
 Image_Result image_convolution(image *dst, const image *src, const double *kernel, int kernel_size) {
   size_t row, col, image_index;
@@ -37,10 +192,13 @@ Image_Result image_convolution(image *dst, const image *src, const double *kerne
   }
 
   /* convolution inner squre */
+#ifdef _OPENMP
+#pragma omp parallel for private(col, image_index) schedule(static)
+#endif
   for (row = kernel_size/2 ; row < dst->height - (kernel_size/2) ; ++row) { 
     for (col = kernel_size/2 ; col < dst->width - (kernel_size/2) ; ++col) {
       image_index = row * dst->width + col;
-      dst->data[image_index] = pixel_convolution_center(src, kernel, kernel_size, image_index);
+      dst->data[image_index] = pixel_convolution_center(src, kernel, kernel_size, image_index, UCHAR_MAX);
     }
   }
 
@@ -49,8 +207,8 @@ Image_Result image_convolution(image *dst, const image *src, const double *kerne
   pixel_extend_top_bottom_sides(dst, kernel_size, dst->height - kernel_size/2, dst->height, (dst->height - kernel_size/2 - 1) * dst->width);
   
   /* extend left & right, incluing corners */
-  pixel_extend_right_left_sides(dst, kernel_size, 0, kernel_size/2, kernel_size/2);
-  pixel_extend_right_left_sides(dst, kernel_size, dst->width - kernel_size/2, dst->width, dst->width - kernel_size/2 - 1);
+  pixel_extend_right_left_sides(dst, 0, kernel_size/2, kernel_size/2);
+  pixel_extend_right_left_sides(dst, dst->width - kernel_size/2, dst->width, dst->width - kernel_size/2 - 1);
   
   return Image_Success;
 }
@@ -59,20 +217,27 @@ Image_Result image_convolution(image *dst, const image *src, const double *kerne
 Image_Result image_he(image *dst, const image *src) {
   unsigned char min, max;
   size_t *intensity_table = NULL, intensity_table_size;
+  Image_Result status;
   if (NULL == dst || NULL == src) {
     return Image_Uninitialized_Error;
   }
-  if (image_size_compare(dst, src) == 0 || IMAGE_MATRIX_SIZE(src) == 0) {
+  if (image_size_compare(dst, src) == 0) {
     return Image_Size_Error;
   }
-  image_find_min_max(src, &min, &max);
+  if (Image_Success != (status = image_find_min_max(src, &min, &max))) {
+    return status;
+  }
+  if (min == max) { /* flat image, nothing to equalize */
+    memcpy(dst->data, src->data, IMAGE_MATRIX_SIZE(src) * sizeof(unsigned char));
+    return Image_Success;
+  }
   intensity_table_size = max - min + 1;
   if (NULL == (intensity_table = (size_t*)calloc(intensity_table_size, sizeof(size_t)))) {
     return Image_Allocation_Error;
   }
-  image_intensity_counting(intensity_table, src, IMAGE_MATRIX_SIZE(src), min);
+  image_intensity_counting(intensity_table, intensity_table_size, src, min);
   image_cumulative_distribution(intensity_table, intensity_table_size);
-  image_histogram_equalization(intensity_table, src, intensity_table_size);
+  image_histogram_equalization(intensity_table, intensity_table_size, IMAGE_MATRIX_SIZE(src), UCHAR_MAX);
   image_dst_populate(dst, src, intensity_table, min);
   free(intensity_table);
   return Image_Success;
@@ -80,108 +245,370 @@ Image_Result image_he(image *dst, const image *src) {
 
 
 Image_Result image_find_min_max(const image *img, unsigned char *min, unsigned char *max) {
-  int i = 1, image_size;
+  size_t chunk, chunk_count, image_size;
+  unsigned char image_min, image_max, chunk_min, chunk_max;
+  Image_Result status;
   if (NULL == img || NULL == min || NULL == max) {
     return Image_Uninitialized_Error;
   }
-  *min = img->data[0];
-  *max = img->data[0];
-  image_size = img->height * img->width;
-  for ( ; i < image_size - 3 ; i += 4) {
-    CHECK_MIN_MAX(img->data[i], *min, *max)
-    CHECK_MIN_MAX(img->data[i+1], *min, *max)
-    CHECK_MIN_MAX(img->data[i+2], *min, *max)
-    CHECK_MIN_MAX(img->data[i+3], *min, *max)
+  if (Image_Success != (status = image_matrix_checking(img))) {
+    return status;
   }
+  image_min = image_max = img->data[0];
+  image_size = IMAGE_MATRIX_SIZE(img);
+  chunk_count = IMAGE_CHUNK_COUNT(image_size);
+#ifdef _OPENMP
+#pragma omp parallel for private(chunk_min, chunk_max) reduction(min:image_min) reduction(max:image_max) schedule(static)
+#endif
+  for (chunk = 0 ; chunk < chunk_count ; ++chunk) {
+    pixels_find_min_max(img->data + chunk * IMAGE_CHUNK_PIXELS, IMAGE_CHUNK_LENGTH(chunk, image_size), &chunk_min, &chunk_max);
+    image_min = chunk_min < image_min ? chunk_min : image_min;
+    image_max = chunk_max > image_max ? chunk_max : image_max;
+  }
+  *min = image_min;
+  *max = image_max;
+  return Image_Success;
+}
+
 
-  /* check for last elements */
-  for ( ; i < image_size ; ++i) {
-    CHECK_MIN_MAX(img->data[i], *min, *max)
+Image_Result image16_convolution(image16 *dst, const image16 *src, const double *kernel, int kernel_size) {
+  size_t row, col, image_index;
+  Image_Result status;
+  if (kernel_size % 2 == 0 || kernel_size < 0) {
+    return Image_KernelSize_Error;
+  }
+  if (NULL == kernel) {
+    return Image_Uninitialized_Error;
+  }
+  if (Image_Success != (status = image16_validation_checking(dst, src))) {
+    return status;
+  }
+  if ((size_t)kernel_size > src->height || (size_t)kernel_size > src->width) {
+    return Image_KernelSize_Error;
+  }
+
+  /* convolution inner squre */
+#ifdef _OPENMP
+#pragma omp parallel for private(col, image_index) schedule(static)
+#endif
+  for (row = kernel_size/2 ; row < dst->height - (kernel_size/2) ; ++row) { 
+    for (col = kernel_size/2 ; col < dst->width - (kernel_size/2) ; ++col) {
+      image_index = row * dst->width + col;
+      dst->data[image_index] = pixel16_convolution_center(src, kernel, kernel_size, image_index, IMAGE16_MAX_VALUE(src));
+    }
   }
 
+  /* extend top & bottom */
+  pixel16_extend_top_bottom_sides(dst, kernel_size, 0, kernel_size/2, kernel_size/2 * dst->width);
+  pixel16_extend_top_bottom_sides(dst, kernel_size, dst->height - kernel_size/2, dst->height, (dst->height - kernel_size/2 - 1) * dst->width);
+  
+  /* extend left & right, incluing corners */
+  pixel16_extend_right_left_sides(dst, 0, kernel_size/2, kernel_size/2);
+  pixel16_extend_right_left_sides(dst, dst->width - kernel_size/2, dst->width, dst->width - kernel_size/2 - 1);
+  
   return Image_Success;
 }
 
 
+Image_Result image16_he(image16 *dst, const image16 *src) {
+  unsigned short min, max;
+  size_t *block_table = NULL, *intensity_table = NULL, block_table_size, intensity_table_size;
+  Image_Result status = image16_validation_checking(dst, src);
+  if (Image_Success != status) {
+    return status;
+  }
+  image16_find_min_max(src, &min, &max);
+  if (min == max) { /* flat image, nothing to equalize */
+    memcpy(dst->data, src->data, IMAGE_MATRIX_SIZE(src) * sizeof(unsigned short));
+    return Image_Success;
+  }
 
+  /* first level - count high bytes of (pixel - min) */
+  block_table_size = ((size_t)(max - min) >> HE_BLOCK_BITS) + 1;
+  if (NULL == (block_table = (size_t*)calloc(block_table_size, sizeof(size_t)))) {
+    return Image_Allocation_Error;
+  }
+  image16_block_counting(block_table, block_table_size, src, min);
 
-/* static functions */
+  /* second level - low byte bins, only for non empty blocks */
+  intensity_table_size = image16_block_indexing(block_table, block_table_size) * HE_BLOCK_SIZE;
+  if (NULL == (intensity_table = (size_t*)calloc(intensity_table_size, sizeof(size_t)))) {
+    free(block_table);
+    return Image_Allocation_Error;
+  }
+  if (Image_Success != (status = image16_intensity_counting(intensity_table, intensity_table_size, block_table, src, min))) {
+    free(intensity_table);
+    free(block_table);
+    return status;
+  }
+  image_cumulative_distribution(intensity_table, intensity_table_size);
+  image_histogram_equalization(intensity_table, intensity_table_size, IMAGE_MATRIX_SIZE(src), IMAGE16_MAX_VALUE(dst));
+  image16_dst_populate(dst, src, intensity_table, block_table, min);
+  free(intensity_table);
+  free(block_table);
+  return Image_Success;
+}
 
-static double pixel_convolution_center(const image *img, const double *kernel, int kernel_size, size_t image_index) {
-  double retval = 0;
-  size_t current_image_index, current_kernel_index;
-  int i, j;
-  for (i = -(kernel_size / 2) ; i <= kernel_size / 2 ; ++i) {
-    for (j = -(kernel_size / 2) ; j <= kernel_size / 2 ; ++j) {
-      current_image_index = image_index + (i * img->width) + j;
-      current_kernel_index = CENTRAL_KERNEL_INDEX(kernel_size) - (i * kernel_size) - j;
-      retval += img->data[current_image_index] * kernel[current_kernel_index];
-    }
+
+Image_Result image16_find_min_max(const image16 *img, unsigned short *min, unsigned short *max) {
+  size_t chunk, chunk_count, image_size;
+  unsigned short image_min, image_max, chunk_min, chunk_max;
+  if (NULL == img || NULL == min || NULL == max) {
+    return Image_Uninitialized_Error;
+  }
+  if (IMAGE_MATRIX_OVERFLOWS(img) || IMAGE_MATRIX_SIZE(img) == 0) {
+    return Image_Size_Error;
+  }
+  image_min = image_max = img->data[0];
+  image_size = IMAGE_MATRIX_SIZE(img);
+  chunk_count = IMAGE_CHUNK_COUNT(image_size);
+#ifdef _OPENMP
+#pragma omp parallel for private(chunk_min, chunk_max) reduction(min:image_min) reduction(max:image_max) schedule(static)
+#endif
+  for (chunk = 0 ; chunk < chunk_count ; ++chunk) {
+    pixels16_find_min_max(img->data + chunk * IMAGE_CHUNK_PIXELS, IMAGE_CHUNK_LENGTH(chunk, image_size), &chunk_min, &chunk_max);
+    image_min = chunk_min < image_min ? chunk_min : image_min;
+    image_max = chunk_max > image_max ? chunk_max : image_max;
   }
-  return retval > UCHAR_MAX ? UCHAR_MAX : retval < 0 ? 0 : retval;
+  *min = image_min;
+  *max = image_max;
+  return Image_Success;
 }
 
 
-/* not include corners */
-static void pixel_extend_top_bottom_sides(image *dst, int kernel_size, int first_row, int last_row, int first_in_row_to_extend) {
-  int row, col;
-  for (row = first_row ; row < last_row ; ++row) { 
-    for (col = kernel_size/2 ; col < dst->width - kernel_size/2 ; ++col) {
-      dst->data[row * dst->width + col] = dst->data[first_in_row_to_extend + col];
-    }
+
+
+image_he_stream* image_he_stream_create(double smoothing, double threshold) {
+  image_he_stream *stream = NULL;
+  if (smoothing < 0 || smoothing >= 1 || threshold < 0) {
+    return NULL;
+  }
+  if (NULL == (stream = (image_he_stream*)calloc(1, sizeof(image_he_stream)))) {
+    return NULL;
   }
+  stream->smoothing = smoothing;
+  stream->threshold = threshold;
+  return stream;
 }
 
 
-/* include corners */
-static void pixel_extend_right_left_sides(image *dst, int kernel_size, int first_col, int last_col, int first_in_col_to_extend) {
-  int row, col;
-  for (row = 0 ; row < dst->height ; ++row) { 
-    for (col = first_col ; col < last_col ; ++col) {
-      dst->data[row * dst->width + col] = dst->data[row * dst->width + first_in_col_to_extend];
+void image_he_stream_destroy(image_he_stream **stream) {
+  if (NULL == stream || NULL == *stream) {
+    return;
+  }
+  free(*stream);
+  *stream = NULL;
+}
+
+
+Image_Result image_he_stream_frame(image_he_stream *stream, image *dst, const image *src) {
+  size_t i, image_size;
+  Image_Result status;
+  if (NULL == stream || NULL == dst || NULL == src) {
+    return Image_Uninitialized_Error;
+  }
+  if (image_size_compare(dst, src) == 0) {
+    return Image_Size_Error;
+  }
+  if (Image_Success != (status = image_matrix_checking(src))) {
+    return status;
+  }
+  image_size = IMAGE_MATRIX_SIZE(src);
+  for (i = 0 ; i < HE_STREAM_TABLE_SIZE ; ++i) {
+    stream->frame_histogram[i] = 0;
+  }
+
+  /* first frame, still settling, or in place - count, then build or reuse the lut, then apply */
+  if (0 == stream->image_size || stream->lag > HE_STREAM_SETTLED || dst->data == src->data) {
+    image_intensity_counting(stream->frame_histogram, HE_STREAM_TABLE_SIZE, src, 0);
+    if (0 == stream->image_size || stream->lag > HE_STREAM_SETTLED || he_stream_histogram_distance(stream, image_size) > stream->threshold) {
+      he_stream_lut_update(stream, image_size);
     }
+    image_lut_apply(dst, src, stream->lut);
+    return Image_Success;
+  }
+
+  /* apply the cached lut while counting - a reused lut costs this single pass */
+  image_lut_apply_counting(stream->frame_histogram, dst, src, stream->lut);
+  if (he_stream_histogram_distance(stream, image_size) > stream->threshold) {
+    he_stream_lut_update(stream, image_size);
+    image_lut_apply(dst, src, stream->lut);
+  }
+  return Image_Success;
+}
+
+
+
+
+Image_Result image_resize(image *dst, const image *src, Image_Filter filter) {
+  image_resize_plan *plan = NULL;
+  Image_Result status;
+  if (NULL == dst || NULL == src) {
+    return Image_Uninitialized_Error;
+  }
+  if (filter < Image_Filter_Nearest || filter > Image_Filter_Lanczos3) {
+    return Image_Filter_Error;
+  }
+  if (Image_Success != image_matrix_checking(dst) || Image_Success != image_matrix_checking(src)) {
+    return Image_Size_Error;
+  }
+  if (NULL == (plan = image_resize_plan_create(dst->height, dst->width, src->height, src->width, filter))) {
+    return Image_Allocation_Error;
+  }
+  status = image_resize_with_plan(dst, src, plan);
+  image_resize_plan_destroy(&plan);
+  return status;
+}
+
+
+image_resize_plan* image_resize_plan_create(size_t dst_height, size_t dst_width, size_t src_height, size_t src_width, Image_Filter filter) {
+  image_resize_plan *plan = NULL;
+  if (0 == dst_height || 0 == dst_width || 0 == src_height || 0 == src_width) {
+    return NULL;
+  }
+  if (SIZE_MUL_OVERFLOWS(dst_height, dst_width) || SIZE_MUL_OVERFLOWS(src_height, src_width)) {
+    return NULL;
+  }
+  if (filter < Image_Filter_Nearest || filter > Image_Filter_Lanczos3) {
+    return NULL;
+  }
+  if (NULL == (plan = (image_resize_plan*)calloc(1, sizeof(image_resize_plan)))) {
+    return NULL;
+  }
+  if (0 == resize_axis_create(&plan->horizontal, dst_width, src_width, filter, RESIZE_HORIZONTAL_TAP_MULTIPLE) ||
+      0 == resize_axis_create(&plan->vertical, dst_height, src_height, filter, 1)) {
+    image_resize_plan_destroy(&plan);
+    return NULL;
   }
+  plan->dst_height = dst_height;
+  plan->dst_width = dst_width;
+  plan->src_height = src_height;
+  plan->src_width = src_width;
+  return plan;
 }
 
 
+void image_resize_plan_destroy(image_resize_plan **plan) {
+  if (NULL == plan || NULL == *plan) {
+    return;
+  }
+  resize_axis_destroy(&(*plan)->horizontal);
+  resize_axis_destroy(&(*plan)->vertical);
+  free(*plan);
+  *plan = NULL;
+}
+
+
+Image_Result image_resize_with_plan(image *dst, const image *src, const image_resize_plan *plan) {
+  size_t chunk, chunk_count, last_row;
+  int failures = 0;
+  if (NULL == dst || NULL == src || NULL == plan) {
+    return Image_Uninitialized_Error;
+  }
+  if (dst->height != plan->dst_height || dst->width != plan->dst_width ||
+      src->height != plan->src_height || src->width != plan->src_width) {
+    return Image_Size_Error;
+  }
+
+  /* independent bands of destination rows, each with its own row buffers */
+  chunk_count = dst->height / RESIZE_CHUNK_ROWS + (0 != dst->height % RESIZE_CHUNK_ROWS);
+#ifdef _OPENMP
+#pragma omp parallel for private(last_row) reduction(+:failures) schedule(dynamic)
+#endif
+  for (chunk = 0 ; chunk < chunk_count ; ++chunk) {
+    last_row = (chunk + 1) * RESIZE_CHUNK_ROWS;
+    last_row = last_row > dst->height ? dst->height : last_row;
+    failures += (Image_Success != resize_rows(dst, src, plan, chunk * RESIZE_CHUNK_ROWS, last_row));
+  }
+  return 0 == failures ? Image_Success : Image_Allocation_Error;
+}
+
+
+
+
+/* static functions */
+
+DEFINE_PIXEL_CONVOLUTION_CENTER(pixel_convolution_center, image)
+DEFINE_PIXEL_EXTEND_TOP_BOTTOM_SIDES(pixel_extend_top_bottom_sides, image)
+DEFINE_PIXEL_EXTEND_RIGHT_LEFT_SIDES(pixel_extend_right_left_sides, image)
+DEFINE_PIXELS_FIND_MIN_MAX(pixels_find_min_max, unsigned char)
+
+DEFINE_PIXEL_CONVOLUTION_CENTER(pixel16_convolution_center, image16)
+DEFINE_PIXEL_EXTEND_TOP_BOTTOM_SIDES(pixel16_extend_top_bottom_sides, image16)
+DEFINE_PIXEL_EXTEND_RIGHT_LEFT_SIDES(pixel16_extend_right_left_sides, image16)
+DEFINE_PIXELS_FIND_MIN_MAX(pixels16_find_min_max, unsigned short)
+
+
 static int image_size_compare(const image* first, const image* second) {
   return (first->height == second->height && first->width == second->width);
 }
 
 
-static void image_intensity_counting(size_t *intensity_table, const image *src, size_t table_size, unsigned char min) {
-  unsigned int i = 0;
-  for ( ; i < table_size ; ++i) {
-    ++(intensity_table[src->data[i] - min]);
+/* each chunk counts into its own table, merged into @intensity_table (at most UCHAR_MAX + 1 entries) */
+static void image_intensity_counting(size_t *intensity_table, size_t table_size, const image *src, unsigned char min) {
+  size_t chunk, i, image_size = IMAGE_MATRIX_SIZE(src), chunk_count = IMAGE_CHUNK_COUNT(image_size);
+  size_t chunk_table[UCHAR_MAX + 1];
+#ifdef _OPENMP
+#pragma omp parallel for private(i, chunk_table) schedule(static)
+#endif
+  for (chunk = 0 ; chunk < chunk_count ; ++chunk) {
+    for (i = 0 ; i < table_size ; ++i) {
+      chunk_table[i] = 0;
+    }
+    pixels_intensity_counting(chunk_table, src->data + chunk * IMAGE_CHUNK_PIXELS, IMAGE_CHUNK_LENGTH(chunk, image_size), min);
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+    for (i = 0 ; i < table_size ; ++i) {
+      intensity_table[i] += chunk_table[i];
+    }
+  }
+}
+
+
+static void pixels_intensity_counting(size_t *intensity_table, const unsigned char *data, size_t size, unsigned char min) {
+  size_t i = 0;
+  for ( ; i < size ; ++i) {
+    ++(intensity_table[data[i] - min]);
   }
 }
 
 
 static void image_cumulative_distribution(size_t *intensity_table, size_t table_size) {
-  unsigned int i = 1;
+  size_t i = 1;
   for ( ; i < table_size ; ++i) {
     intensity_table[i] += intensity_table[i-1];
   }
 }
 
 
-static void image_histogram_equalization(size_t *intensity_table, const image *src, size_t table_size) {
-  unsigned int i = 0;
-  unsigned char cdf_min = intensity_table[0];
+static void image_histogram_equalization(size_t *intensity_table, size_t table_size, size_t image_size, size_t max_value) {
+  size_t i = 0;
+  size_t cdf_min = intensity_table[0];
   for ( ; i < table_size ; ++i) {
-    intensity_table[i] = round((((double)intensity_table[i] - cdf_min) * (UCHAR_MAX)) / (IMAGE_MATRIX_SIZE(src) - cdf_min));
+    intensity_table[i] = round((((double)intensity_table[i] - cdf_min) * (max_value)) / (image_size - cdf_min));
   }
 }
 
 
 static void image_dst_populate(image *dst, const image *src, size_t *intensity_table, unsigned char min) {
-  unsigned int i = 0;
-  size_t size = IMAGE_MATRIX_SIZE(dst);
+  size_t i, size = IMAGE_MATRIX_SIZE(dst);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static, IMAGE_CHUNK_PIXELS)
+#endif
   for (i = 0 ; i < size ; ++i) {
     dst->data[i] = intensity_table[src->data[i] - min];
   }
 }
 
+
+static Image_Result image_matrix_checking(const image *img) {
+  if (IMAGE_MATRIX_OVERFLOWS(img) || IMAGE_MATRIX_SIZE(img) == 0) {
+    return Image_Size_Error;
+  }
+  return Image_Success;
+}
+
 static Image_Result convolution_validation_checking(const image *dst, const image *src, const double *kernel, int kernel_size) {
   if (kernel_size % 2 == 0 || kernel_size < 0) {
     return Image_KernelSize_Error;
@@ -189,8 +616,567 @@ static Image_Result convolution_validation_checking(const image *dst, const imag
   if (NULL == dst || NULL == src || NULL == kernel) {
     return Image_Uninitialized_Error;
   }
-  if (image_size_compare(dst, src) == 0 || IMAGE_MATRIX_SIZE(src) == 0) {
+  if (image_size_compare(dst, src) == 0 || Image_Success != image_matrix_checking(src)) {
     return Image_Size_Error;
   }
+  if ((size_t)kernel_size > src->height || (size_t)kernel_size > src->width) {
+    return Image_KernelSize_Error;
+  }
   return Image_Success;
-}
\ No newline at end of file
+}
+
+
+static Image_Result image16_validation_checking(const image16 *dst, const image16 *src) {
+  if (NULL == dst || NULL == src) {
+    return Image_Uninitialized_Error;
+  }
+  if (dst->height != src->height || dst->width != src->width || IMAGE_MATRIX_OVERFLOWS(src) || IMAGE_MATRIX_SIZE(src) == 0) {
+    return Image_Size_Error;
+  }
+  if (dst->bit_depth != src->bit_depth || src->bit_depth < 1 || src->bit_depth > 16) {
+    return Image_BitDepth_Error;
+  }
+  return Image_Success;
+}
+
+
+/* (max - min) >> HE_BLOCK_BITS is below HE_BLOCK_SIZE, so chunk tables fit on the stack */
+static void image16_block_counting(size_t *block_table, size_t block_table_size, const image16 *src, unsigned short min) {
+  size_t chunk, i, image_size = IMAGE_MATRIX_SIZE(src), chunk_count = IMAGE_CHUNK_COUNT(image_size);
+  size_t chunk_table[HE_BLOCK_SIZE];
+#ifdef _OPENMP
+#pragma omp parallel for private(i, chunk_table) schedule(static)
+#endif
+  for (chunk = 0 ; chunk < chunk_count ; ++chunk) {
+    for (i = 0 ; i < block_table_size ; ++i) {
+      chunk_table[i] = 0;
+    }
+    pixels16_block_counting(chunk_table, src->data + chunk * IMAGE_CHUNK_PIXELS, IMAGE_CHUNK_LENGTH(chunk, image_size), min);
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+    for (i = 0 ; i < block_table_size ; ++i) {
+      block_table[i] += chunk_table[i];
+    }
+  }
+}
+
+
+static void pixels16_block_counting(size_t *block_table, const unsigned short *data, size_t size, unsigned short min) {
+  size_t i = 0;
+  for ( ; i < size ; ++i) {
+    ++(block_table[(size_t)(data[i] - min) >> HE_BLOCK_BITS]);
+  }
+}
+
+
+/* replaces each non empty block's count with its offset in the packed intensity table,
+   returns the number of non empty blocks */
+static size_t image16_block_indexing(size_t *block_table, size_t block_table_size) {
+  size_t i = 0, block_count = 0;
+  for ( ; i < block_table_size ; ++i) {
+    if (0 != block_table[i]) {
+      block_table[i] = block_count++ * HE_BLOCK_SIZE;
+    }
+  }
+  return block_count;
+}
+
+
+/* the packed table has up to 64K entries, so chunk tables are allocated */
+static Image_Result image16_intensity_counting(size_t *intensity_table, size_t intensity_table_size, const size_t *block_table, const image16 *src, unsigned short min) {
+  size_t chunk, i, image_size = IMAGE_MATRIX_SIZE(src), chunk_count = IMAGE_CHUNK_COUNT(image_size);
+  size_t *chunk_table;
+  int failures = 0;
+#ifdef _OPENMP
+#pragma omp parallel for private(i, chunk_table) reduction(+:failures) schedule(static)
+#endif
+  for (chunk = 0 ; chunk < chunk_count ; ++chunk) {
+    if (NULL == (chunk_table = (size_t*)calloc(intensity_table_size, sizeof(size_t)))) {
+      ++failures;
+      continue;
+    }
+    pixels16_intensity_counting(chunk_table, block_table, src->data + chunk * IMAGE_CHUNK_PIXELS, IMAGE_CHUNK_LENGTH(chunk, image_size), min);
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+    for (i = 0 ; i < intensity_table_size ; ++i) {
+      intensity_table[i] += chunk_table[i];
+    }
+    free(chunk_table);
+  }
+  return 0 == failures ? Image_Success : Image_Allocation_Error;
+}
+
+
+static void pixels16_intensity_counting(size_t *intensity_table, const size_t *block_table, const unsigned short *data, size_t size, unsigned short min) {
+  size_t i = 0, offset;
+  for ( ; i < size ; ++i) {
+    offset = data[i] - min;
+    ++(intensity_table[block_table[offset >> HE_BLOCK_BITS] + (offset & HE_BLOCK_MASK)]);
+  }
+}
+
+
+static void image16_dst_populate(image16 *dst, const image16 *src, const size_t *intensity_table, const size_t *block_table, unsigned short min) {
+  size_t i, size = IMAGE_MATRIX_SIZE(dst), offset;
+#ifdef _OPENMP
+#pragma omp parallel for private(offset) schedule(static, IMAGE_CHUNK_PIXELS)
+#endif
+  for (i = 0 ; i < size ; ++i) {
+    offset = src->data[i] - min;
+    dst->data[i] = intensity_table[block_table[offset >> HE_BLOCK_BITS] + (offset & HE_BLOCK_MASK)];
+  }
+}
+
+
+/* L1 distance between current frame's and lut's normalized histograms */
+static double he_stream_histogram_distance(const image_he_stream *stream, size_t image_size) {
+  double distance = 0;
+  size_t i = 0;
+  for ( ; i < HE_STREAM_TABLE_SIZE ; ++i) {
+    distance += fabs((double)stream->frame_histogram[i] / image_size - (double)stream->histogram[i] / stream->image_size);
+  }
+  return distance;
+}
+
+
+/* blends the frame's CDF into the smoothed one, which snaps to it once settled */
+static void he_stream_lut_update(image_he_stream *stream, size_t image_size) {
+  size_t i = 0, cdf = 0, cdf_min = 0;
+  double frame_cdf[HE_STREAM_TABLE_SIZE], smoothing = (0 == stream->image_size) ? 0 : stream->smoothing;
+  while (0 == (cdf_min = stream->frame_histogram[i])) {
+    ++i;
+  }
+  stream->lag = 0;
+  for (i = 0 ; i < HE_STREAM_TABLE_SIZE ; ++i) {
+    cdf += stream->frame_histogram[i];
+    if (image_size == cdf_min) { /* flat frame, keep intensities */
+      frame_cdf[i] = i;
+    }
+    else { /* same expression as image_he, so a settled lut matches it */
+      frame_cdf[i] = cdf < cdf_min ? 0 : (((double)cdf - cdf_min) * UCHAR_MAX) / (image_size - cdf_min);
+    }
+    stream->cdf[i] = smoothing * stream->cdf[i] + (1 - smoothing) * frame_cdf[i];
+    if (fabs(stream->cdf[i] - frame_cdf[i]) > stream->lag) {
+      stream->lag = fabs(stream->cdf[i] - frame_cdf[i]);
+    }
+    stream->histogram[i] = stream->frame_histogram[i];
+  }
+  for (i = 0 ; i < HE_STREAM_TABLE_SIZE ; ++i) {
+    if (stream->lag <= HE_STREAM_SETTLED) {
+      stream->cdf[i] = frame_cdf[i];
+    }
+    stream->lut[i] = round(stream->cdf[i]);
+  }
+  stream->image_size = image_size;
+}
+
+
+static void image_lut_apply(image *dst, const image *src, const unsigned char *lut) {
+  size_t chunk, image_size = IMAGE_MATRIX_SIZE(dst), chunk_count = IMAGE_CHUNK_COUNT(image_size);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+  for (chunk = 0 ; chunk < chunk_count ; ++chunk) {
+    pixels_lut_apply(dst->data + chunk * IMAGE_CHUNK_PIXELS, src->data + chunk * IMAGE_CHUNK_PIXELS, IMAGE_CHUNK_LENGTH(chunk, image_size), lut);
+  }
+}
+
+
+static void pixels_lut_apply(unsigned char *dst, const unsigned char *src, size_t size, const unsigned char *lut) {
+  size_t i = 0;
+  for ( ; i + 3 < size ; i += 4) {
+    dst[i] = lut[src[i]];
+    dst[i+1] = lut[src[i+1]];
+    dst[i+2] = lut[src[i+2]];
+    dst[i+3] = lut[src[i+3]];
+  }
+
+  /* last elements */
+  for ( ; i < size ; ++i) {
+    dst[i] = lut[src[i]];
+  }
+}
+
+
+/* each chunk counts into its own table, merged into @intensity_table (UCHAR_MAX + 1 entries) */
+static void image_lut_apply_counting(size_t *intensity_table, image *dst, const image *src, const unsigned char *lut) {
+  size_t chunk, i, image_size = IMAGE_MATRIX_SIZE(src), chunk_count = IMAGE_CHUNK_COUNT(image_size);
+  size_t chunk_table[UCHAR_MAX + 1];
+#ifdef _OPENMP
+#pragma omp parallel for private(i, chunk_table) schedule(static)
+#endif
+  for (chunk = 0 ; chunk < chunk_count ; ++chunk) {
+    for (i = 0 ; i <= UCHAR_MAX ; ++i) {
+      chunk_table[i] = 0;
+    }
+    pixels_lut_apply_counting(chunk_table, dst->data + chunk * IMAGE_CHUNK_PIXELS, src->data + chunk * IMAGE_CHUNK_PIXELS, IMAGE_CHUNK_LENGTH(chunk, image_size), lut);
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+    for (i = 0 ; i <= UCHAR_MAX ; ++i) {
+      intensity_table[i] += chunk_table[i];
+    }
+  }
+}
+
+
+/* four interleaved tables, so repeated intensities don't serialize on one counter */
+static void pixels_lut_apply_counting(size_t *intensity_table, unsigned char *dst, const unsigned char *src, size_t size, const unsigned char *lut) {
+  size_t i = 0, tables[4][UCHAR_MAX + 1] = { { 0 } };
+  unsigned char pixel0, pixel1, pixel2, pixel3;
+  for ( ; i + 3 < size ; i += 4) {
+    pixel0 = src[i];
+    pixel1 = src[i+1];
+    pixel2 = src[i+2];
+    pixel3 = src[i+3];
+    ++(tables[0][pixel0]);
+    ++(tables[1][pixel1]);
+    ++(tables[2][pixel2]);
+    ++(tables[3][pixel3]);
+    dst[i] = lut[pixel0];
+    dst[i+1] = lut[pixel1];
+    dst[i+2] = lut[pixel2];
+    dst[i+3] = lut[pixel3];
+  }
+
+  /* last elements */
+  for ( ; i < size ; ++i) {
+    ++(tables[0][src[i]]);
+    dst[i] = lut[src[i]];
+  }
+  for (i = 0 ; i <= UCHAR_MAX ; ++i) {
+    intensity_table[i] += tables[0][i] + tables[1][i] + tables[2][i] + tables[3][i];
+  }
+}
+
+
+static double resize_filter_support(Image_Filter filter) {
+  switch (filter) {
+    case Image_Filter_Bilinear:
+      return 1.0;
+    case Image_Filter_Bicubic:
+      return 2.0;
+    case Image_Filter_Lanczos3:
+      return 3.0;
+    default: /* nearest, area */
+      return 0.5;
+  }
+}
+
+
+static double resize_filter_weight(Image_Filter filter, double x) {
+  const double a = -0.5; /* bicubic */
+  x = fabs(x);
+  switch (filter) {
+    case Image_Filter_Bilinear:
+      return x < 1.0 ? 1.0 - x : 0;
+    case Image_Filter_Bicubic:
+      if (x < 1.0) {
+        return ((a + 2.0) * x - (a + 3.0)) * x * x + 1;
+      }
+      return x < 2.0 ? (((x - 5) * x + 8) * x - 4) * a : 0;
+    case Image_Filter_Lanczos3:
+      if (x < 1e-8) {
+        return 1.0;
+      }
+      return x < 3.0 ? 3.0 * sin(RESIZE_PI * x) * sin(RESIZE_PI * x / 3.0) / (RESIZE_PI * RESIZE_PI * x * x) : 0;
+    default: /* area */
+      return x <= 0.5 ? 1.0 : 0;
+  }
+}
+
+
+/* returns 0 on allocation failure, or if a window has more taps than weight units */
+static int resize_axis_create(resize_axis *axis, size_t dst_size, size_t src_size, Image_Filter filter, size_t tap_multiple) {
+  double scale = (double)src_size / dst_size, filter_scale = scale < 1.0 ? 1.0 : scale;
+  double support = resize_filter_support(filter) * filter_scale, center, lower, upper, total, largest = 0, cumulative;
+  double *kernels = NULL, *kernel;
+  size_t i, j, first, last, bound, start, offset, *count = NULL;
+  short *window;
+  long rounded, previous;
+
+  /* taps a window can reach, windows are trimmed to their nonzero weights below */
+  bound = (Image_Filter_Nearest == filter) ? 1 : (size_t)ceil(support) * 2 + 1;
+  if (bound > src_size) {
+    bound = src_size;
+  }
+  if (SIZE_MUL_OVERFLOWS(dst_size, sizeof(size_t)) || SIZE_MUL_OVERFLOWS(dst_size, bound)) {
+    return 0;
+  }
+  axis->first = (size_t*)malloc(dst_size * sizeof(size_t));
+  count = (size_t*)malloc(dst_size * sizeof(size_t));
+  kernels = (double*)calloc(dst_size * bound, sizeof(double));
+  if (NULL == axis->first || NULL == count || NULL == kernels) {
+    free(count);
+    free(kernels);
+    return 0;
+  }
+
+  for (i = 0 ; i < dst_size ; ++i) {
+    center = (i + 0.5) * scale;
+    kernel = kernels + i * bound;
+    if (Image_Filter_Nearest == filter) {
+      axis->first[i] = ((size_t)center < src_size) ? (size_t)center : src_size - 1;
+      count[i] = 1;
+      kernel[0] = 1.0;
+      largest = 1.0;
+      continue;
+    }
+
+    lower = center - support + 0.5;
+    first = lower < 0 ? 0 : (size_t)lower;
+    upper = center + support + 0.5;
+    last = upper > src_size ? src_size : (size_t)upper;
+    total = 0;
+    for (j = 0 ; j < last - first ; ++j) {
+      kernel[j] = resize_filter_weight(filter, ((double)(first + j) - center + 0.5) / filter_scale);
+      total += kernel[j];
+    }
+
+    for (j = 0 ; j < last - first ; ++j) {
+      kernel[j] = (0 != total) ? kernel[j] / total : 0;
+    }
+
+    /* drop the window's end weights that round to zero even at full precision */
+    while (last - first > 1 && fabs(kernel[last - first - 1]) * (1L << RESIZE_PRECISION_BITS) < 0.5) {
+      --last;
+    }
+    j = 0;
+    while (j + 1 < last - first && fabs(kernel[j]) * (1L << RESIZE_PRECISION_BITS) < 0.5) {
+      ++j;
+    }
+    memmove(kernel, kernel + j, (last - first - j) * sizeof(double));
+    axis->first[i] = first + j;
+    count[i] = last - first - j;
+    for (j = 0 ; j < count[i] ; ++j) {
+      if (fabs(kernel[j]) > largest) {
+        largest = fabs(kernel[j]);
+      }
+    }
+  }
+
+  /* windows are placed at the earliest start from theirs on, so starts never move up and
+     the ring buffer holds every window; taps covers each window from there */
+  axis->taps = 1;
+  start = src_size;
+  for (i = dst_size ; i-- > 0 ; ) {
+    start = axis->first[i] < start ? axis->first[i] : start;
+    if (axis->first[i] + count[i] - start > axis->taps) {
+      axis->taps = axis->first[i] + count[i] - start;
+    }
+  }
+
+  /* the most precision that keeps every weight in a short */
+  axis->precision = RESIZE_PRECISION_BITS;
+  while (axis->precision > 0 && largest * (1L << axis->precision) + 1 > SHRT_MAX) {
+    --axis->precision;
+  }
+  if (1 < axis->taps && 0 != axis->taps % tap_multiple && axis->taps + tap_multiple - axis->taps % tap_multiple <= src_size) {
+    axis->taps += tap_multiple - axis->taps % tap_multiple;
+  }
+  /* more taps than weight units would round most taps to zero */
+  if (0 == axis->precision || axis->taps > (size_t)1 << axis->precision || SIZE_MUL_OVERFLOWS(dst_size, axis->taps) ||
+      NULL == (axis->weights = (short*)calloc(dst_size * axis->taps, sizeof(short)))) {
+    free(count);
+    free(kernels);
+    return 0;
+  }
+
+  /* zero pad every window to the same tap count, windows near the end start earlier to stay inside the source */
+  start = src_size;
+  for (i = dst_size ; i-- > 0 ; ) {
+    start = axis->first[i] < start ? axis->first[i] : start;
+    offset = axis->first[i] - (start + axis->taps > src_size ? src_size - axis->taps : start);
+    axis->first[i] -= offset;
+    /* round the running sum, so each weight is off by under one unit and the last one makes the window sum exact */
+    kernel = kernels + i * bound;
+    window = axis->weights + i * axis->taps + offset;
+    cumulative = 0;
+    previous = 0;
+    for (j = 0 ; j + 1 < count[i] ; ++j) {
+      cumulative += kernel[j];
+      rounded = (long)floor(cumulative * (1L << axis->precision) + 0.5);
+      window[j] = (short)(rounded - previous);
+      previous = rounded;
+    }
+    window[j] = (short)((1L << axis->precision) - previous);
+  }
+  free(count);
+  free(kernels);
+  return 1;
+}
+
+
+static void resize_axis_destroy(resize_axis *axis) {
+  free(axis->first);
+  free(axis->weights);
+}
+
+
+static unsigned char resize_clip(int value, int precision) {
+  if (value < 0) {
+    return 0;
+  }
+  value >>= precision;
+  return value > UCHAR_MAX ? UCHAR_MAX : value;
+}
+
+
+static Image_Result resize_rows(image *dst, const image *src, const image_resize_plan *plan, size_t first_row, size_t last_row) {
+  unsigned char *ring = NULL;
+  const unsigned char **ring_window = NULL;
+  size_t row, first, k, next_src_row = 0, ring_rows;
+
+  /* horizontally resized source rows, enough for one vertical window */
+  ring_rows = plan->vertical.taps;
+  if (SIZE_MUL_OVERFLOWS(ring_rows, dst->width)) {
+    return Image_Allocation_Error;
+  }
+  if (NULL == (ring = (unsigned char*)malloc(ring_rows * dst->width * sizeof(unsigned char)))) {
+    return Image_Allocation_Error;
+  }
+  if (NULL == (ring_window = (const unsigned char**)malloc(ring_rows * sizeof(unsigned char*)))) {
+    free(ring);
+    return Image_Allocation_Error;
+  }
+
+  for (row = first_row ; row < last_row ; ++row) {
+    first = plan->vertical.first[row];
+
+    /* windows only move down, source rows above them are never needed again */
+    if (next_src_row < first) {
+      next_src_row = first;
+    }
+    for ( ; next_src_row < first + ring_rows ; ++next_src_row) {
+      resize_horizontal_row(ring + (next_src_row % ring_rows) * dst->width, src->data + next_src_row * src->width, &plan->horizontal, dst->width);
+    }
+    for (k = 0 ; k < ring_rows ; ++k) {
+      ring_window[k] = ring + ((first + k) % ring_rows) * dst->width;
+    }
+    resize_vertical_row(dst->data + row * dst->width, ring_window, &plan->vertical, row, dst->width);
+  }
+
+  free(ring_window);
+  free(ring);
+  return Image_Success;
+}
+
+
+/* axis fields are read into locals, dst_row's char stores could alias them */
+static void resize_horizontal_row(unsigned char *dst_row, const unsigned char *src_row, const resize_axis *axis, size_t dst_width) {
+  const size_t *first = axis->first, taps = axis->taps;
+  const short *weights = axis->weights;
+  const int precision = axis->precision, rounding = 1 << (precision - 1);
+  const unsigned char *src_pixels;
+  size_t col = 0, k;
+  int accumulator;
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128(), shift = _mm_cvtsi32_si128(precision);
+  __m128i sum, low, high;
+  int quad;
+#endif
+  if (1 == taps) { /* nearest */
+    for (col = 0 ; col < dst_width ; ++col) {
+      dst_row[col] = src_row[first[col]];
+    }
+    return;
+  }
+#ifdef __SSE2__
+  /* four columns at a time, two per multiply-add, their taps four by four */
+  if (0 == taps % 4) {
+    for ( ; col + 4 <= dst_width ; col += 4, weights += 4 * taps) {
+      low = high = zero;
+      for (k = 0 ; k < taps ; k += 4) {
+        low = _mm_add_epi32(low, _mm_madd_epi16(resize_load_quads(src_row + first[col] + k, src_row + first[col + 1] + k),
+                                                _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i*)(weights + k)), _mm_loadl_epi64((const __m128i*)(weights + taps + k)))));
+        high = _mm_add_epi32(high, _mm_madd_epi16(resize_load_quads(src_row + first[col + 2] + k, src_row + first[col + 3] + k),
+                                                  _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i*)(weights + 2 * taps + k)), _mm_loadl_epi64((const __m128i*)(weights + 3 * taps + k)))));
+      }
+      /* each column's two partial sums are adjacent lanes, fold them and gather the four columns */
+      low = _mm_shuffle_epi32(_mm_add_epi32(low, _mm_srli_epi64(low, 32)), _MM_SHUFFLE(3, 1, 2, 0));
+      high = _mm_shuffle_epi32(_mm_add_epi32(high, _mm_srli_epi64(high, 32)), _MM_SHUFFLE(3, 1, 2, 0));
+      sum = _mm_sra_epi32(_mm_add_epi32(_mm_unpacklo_epi64(low, high), _mm_set1_epi32(rounding)), shift);
+      sum = _mm_packs_epi32(sum, sum);
+      quad = _mm_cvtsi128_si32(_mm_packus_epi16(sum, sum));
+      memcpy(dst_row + col, &quad, sizeof(quad));
+    }
+  }
+#endif
+  for ( ; col < dst_width ; ++col, weights += taps) {
+    src_pixels = src_row + first[col];
+    k = 0;
+    accumulator = rounding;
+#ifdef __SSE2__
+    /* four widened pixels times four weights, summed in pairs by one multiply-add */
+    sum = zero;
+    for ( ; k + 4 <= taps ; k += 4) {
+      memcpy(&quad, src_pixels + k, sizeof(quad));
+      sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(quad), zero), _mm_loadl_epi64((const __m128i*)(weights + k))));
+    }
+    accumulator += _mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_srli_si128(sum, 4));
+#endif
+    for ( ; k < taps ; ++k) {
+      accumulator += weights[k] * src_pixels[k];
+    }
+    dst_row[col] = resize_clip(accumulator, precision);
+  }
+}
+
+
+#ifdef __SSE2__
+/* four pixels from each of @first and @second, widened to eight shorts */
+static __m128i resize_load_quads(const unsigned char *first, const unsigned char *second) {
+  int first_quad, second_quad;
+  memcpy(&first_quad, first, sizeof(first_quad));
+  memcpy(&second_quad, second, sizeof(second_quad));
+  return _mm_unpacklo_epi8(_mm_unpacklo_epi32(_mm_cvtsi32_si128(first_quad), _mm_cvtsi32_si128(second_quad)), _mm_setzero_si128());
+}
+#endif
+
+
+/* sums a column block over all the window's rows in registers, the window's rows stay in cache */
+static void resize_vertical_row(unsigned char *dst_row, const unsigned char **ring_window, const resize_axis *axis, size_t row, size_t dst_width) {
+  const size_t taps = axis->taps;
+  const short *weights = axis->weights + row * taps;
+  const int precision = axis->precision, rounding = 1 << (precision - 1);
+  size_t col = 0, k;
+  int accumulator;
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128(), shift = _mm_cvtsi32_si128(precision);
+  __m128i low, high, pair, pixels;
+#endif
+  if (1 == taps) { /* nearest */
+    memcpy(dst_row, ring_window[0], dst_width * sizeof(unsigned char));
+    return;
+  }
+#ifdef __SSE2__
+  /* eight columns, two rows at a time - interleaved pixel pairs times a weight pair */
+  for ( ; col + 8 <= dst_width ; col += 8) {
+    low = high = _mm_set1_epi32(rounding);
+    for (k = 0 ; k < taps ; k += 2) {
+      if (k + 1 < taps) {
+        pair = _mm_set1_epi32((int)((unsigned short)weights[k] | (unsigned int)(unsigned short)weights[k + 1] << 16));
+        pixels = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(ring_window[k] + col)), _mm_loadl_epi64((const __m128i*)(ring_window[k + 1] + col)));
+      }
+      else {
+        pair = _mm_set1_epi32((unsigned short)weights[k]);
+        pixels = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(ring_window[k] + col)), zero);
+      }
+      low = _mm_add_epi32(low, _mm_madd_epi16(_mm_unpacklo_epi8(pixels, zero), pair));
+      high = _mm_add_epi32(high, _mm_madd_epi16(_mm_unpackhi_epi8(pixels, zero), pair));
+    }
+    /* saturating packs clip to 0..255 */
+    pixels = _mm_packs_epi32(_mm_sra_epi32(low, shift), _mm_sra_epi32(high, shift));
+    _mm_storel_epi64((__m128i*)(dst_row + col), _mm_packus_epi16(pixels, zero));
+  }
+#endif
+  for ( ; col < dst_width ; ++col) {
+    accumulator = rounding;
+    for (k = 0 ; k < taps ; ++k) {
+      accumulator += weights[k] * ring_window[k][col];
+    }
+    dst_row[col] = resize_clip(accumulator, precision);
+  }
+}
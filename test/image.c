@@ -1,24 +1,34 @@
+#define _DEFAULT_SOURCE /* MAP_ANONYMOUS, MAP_NORESERVE */
 #include "image_processing.h"
 #include <stdio.h> /* printf */
 #include <stdlib.h> /* malloc, free, rand, srand */
 #include <limits.h> /* UCHAR_MAX */
-#include <string.h> /* strcpy */
+#include <string.h> /* strcpy, memset, memcpy */
 #include <time.h> /* time */
 #include <math.h>
+#include <sys/mman.h> /* mmap, munmap */
 
 #define PRINT(FUNC_PTR, STR) if (FUNC_PTR(STR) == 0) { printf("%s\n", STR); }
 
 
-static image* image_create(unsigned int height, unsigned int width);
+static image* image_create(size_t height, size_t width);
 static void image_destroy(image **img);
-static image* image_random_create(unsigned int height, unsigned int width);
+static image* image_random_create(size_t height, size_t width);
+static image* image_mapped_create(size_t height, size_t width);
+static void image_mapped_destroy(image **img);
 static void fill_image_values(image *img, const unsigned char *values, size_t size);
 static int compare_image_values(const unsigned char *first, const unsigned char *second, size_t size);
 void print_image_data(const unsigned char *data, size_t height, size_t width);
+static image16* image16_create(size_t height, size_t width, int bit_depth);
+static void image16_destroy(image16 **img);
+static void fill_image16_values(image16 *img, const unsigned short *values, size_t size);
+static int compare_image16_values(const unsigned short *first, const unsigned short *second, size_t size);
 
 int test_min_max(char *test_name);
 int test_min_max_null(char *test_name);
 int test_min_max_size_1x1(char *test_name);
+int test_min_max_4gpix(char *test_name);
+int test_min_max_size_overflow(char *test_name);
 
 int test_image_histogram(char *test_name);
 int test_image_histogram_null(char *test_name);
@@ -31,6 +41,26 @@ int test_image_convolution_kernel_size(char *test_name);
 int test_image_convolution_image_size_zero(char *test_name);
 void test_image_convolution_on_photo(char *test_name, const char* photo_path, const char* new_photo_path, size_t height, size_t width);
 
+int test_image_he_stream(char *test_name);
+int test_image_he_stream_reuse(char *test_name);
+int test_image_he_stream_smoothing(char *test_name);
+int test_image_he_stream_null(char *test_name);
+
+int test_image_resize_identity(char *test_name);
+int test_image_resize_nearest(char *test_name);
+int test_image_resize_area(char *test_name);
+int test_image_resize_flat(char *test_name);
+int test_image_resize_transpose(char *test_name);
+int test_image_resize_plan(char *test_name);
+int test_image_resize_4gpix(char *test_name);
+
+int test_min_max16(char *test_name);
+int test_image16_histogram(char *test_name);
+int test_image16_histogram_empty_blocks(char *test_name);
+int test_image16_histogram_bit_depth(char *test_name);
+int test_image16_histogram_chunks(char *test_name);
+int test_image16_convolution_identity(char *test_name);
+
 
 int main() {
   char test_name[100];
@@ -42,6 +72,8 @@ int main() {
   PRINT(test_min_max, test_name)
   PRINT(test_min_max_null, test_name)
   PRINT(test_min_max_size_1x1, test_name)
+  PRINT(test_min_max_4gpix, test_name)
+  PRINT(test_min_max_size_overflow, test_name)
   
   /* image_he Function */
   PRINT(test_image_histogram, test_name)
@@ -62,6 +94,29 @@ int main() {
   test_image_convolution_on_photo(test_name, "./chess/blurry_chess_1920x1200", "./chess/convolution_blurry_chess_1920x1200", 1200, 1920);
   test_image_convolution_on_photo(test_name, "./elvis/unequalized_elvis_800x623", "./elvis/convolution_unequalized_elvis_800x623", 623, 800);
 
+  /* image_he_stream Functions */
+  PRINT(test_image_he_stream, test_name)
+  PRINT(test_image_he_stream_reuse, test_name)
+  PRINT(test_image_he_stream_smoothing, test_name)
+  PRINT(test_image_he_stream_null, test_name)
+
+  /* image_resize Functions */
+  PRINT(test_image_resize_identity, test_name)
+  PRINT(test_image_resize_nearest, test_name)
+  PRINT(test_image_resize_area, test_name)
+  PRINT(test_image_resize_flat, test_name)
+  PRINT(test_image_resize_transpose, test_name)
+  PRINT(test_image_resize_plan, test_name)
+  PRINT(test_image_resize_4gpix, test_name)
+
+  /* High bit depth Functions */
+  PRINT(test_min_max16, test_name)
+  PRINT(test_image16_histogram, test_name)
+  PRINT(test_image16_histogram_empty_blocks, test_name)
+  PRINT(test_image16_histogram_bit_depth, test_name)
+  PRINT(test_image16_histogram_chunks, test_name)
+  PRINT(test_image16_convolution_identity, test_name)
+
   return 0;
 }
 
@@ -133,6 +188,35 @@ int test_min_max_size_1x1(char *test_name) {
   return 1;
 }
 
+/* sparse image, past 32 bit indexing - only the touched pages are backed */
+int test_min_max_4gpix(char *test_name) {
+  const size_t height = 65537, width = 65536;
+  unsigned char min, max;
+  image *img = NULL;
+  strcpy(test_name, "test_min_max_4gpix");
+  if (NULL == (img = image_mapped_create(height, width))) {
+    return 0;
+  }
+  img->data[((size_t)1 << 32) + 7] = 200;
+  img->data[height * width - 1] = 255;
+  if (Image_Success != image_find_min_max(img, &min, &max)) {
+    image_mapped_destroy(&img);
+    return 0;
+  }
+  image_mapped_destroy(&img);
+  return (0 == min && 255 == max);
+}
+
+int test_min_max_size_overflow(char *test_name) {
+  unsigned char min, max, pixel = 0;
+  image img;
+  strcpy(test_name, "test_min_max_size_overflow");
+  img.height = (size_t)-1 / 2;
+  img.width = 3;
+  img.data = &pixel;
+  return (Image_Size_Error == image_find_min_max(&img, &min, &max));
+}
+
 
 
 /* image_he Function */
@@ -419,10 +503,579 @@ void test_image_convolution_on_photo(char *test_name, const char* photo_path, co
 }
 
 
+
+/* image_he_stream Functions */
+
+int test_image_he_stream(char *test_name) {
+  const size_t height = 8, width = 8;
+  size_t i;
+  int result;
+  image *src = NULL, *dst = NULL, *he_dst = NULL;
+  image_he_stream *stream = NULL;
+
+  /* The values were taken from Wikipedia - "Histogram equalization" */
+  unsigned char image_pixels_before_he[] = { 52, 55, 61, 59, 79, 61, 76, 61, 62, 59, 55, 104, 94, 85, 59, 71, 63, 65, 66, 113, 144, 104, 63, 72, 64, 70, 70, 126, 154, 109, 71, 69, 67, 73, 68, 106, 122, 88, 68, 68, 68, 79, 60, 70, 77, 66, 58, 75, 69, 85, 64, 58, 55, 61, 65, 83, 70, 87, 69, 68, 65, 73, 78, 90 };
+  unsigned char image_pixels_after_he[] = { 0, 12, 53, 32, 190, 53, 174, 53, 57, 32, 12, 227, 219, 202, 32, 154, 65, 85, 93, 239, 251, 227, 65, 158, 73, 146, 146, 247, 255, 235, 154, 130, 97, 166, 117, 231, 243, 210, 117, 117, 117, 190, 36, 146, 178, 93, 20, 170, 130, 202, 73, 20, 12, 53, 85, 194, 146, 206, 130, 117, 85, 166, 182, 215 };
+
+  strcpy(test_name, "test_image_he_stream");
+  if (NULL == (stream = image_he_stream_create(0, 0))) {
+    return 0;
+  }
+  src = image_create(height, width);
+  dst = image_create(height, width);
+  he_dst = image_create(height, width);
+  if (NULL == src || NULL == dst || NULL == he_dst) {
+    image_he_stream_destroy(&stream);
+    image_destroy(&src);
+    image_destroy(&dst);
+    image_destroy(&he_dst);
+    return 0;
+  }
+  fill_image_values(src, image_pixels_before_he, sizeof(image_pixels_before_he));
+
+  /* first frame is plain histogram equalization */
+  result = (Image_Success == image_he_stream_frame(stream, dst, src));
+  result = result && compare_image_values(dst->data, image_pixels_after_he, sizeof(image_pixels_after_he));
+
+  /* without smoothing a changed frame is equalized on its own */
+  for (i = 0 ; i < height * width ; i += 3) {
+    src->data[i] += 40;
+  }
+  result = result && (Image_Success == image_he_stream_frame(stream, dst, src));
+  result = result && (Image_Success == image_he(he_dst, src));
+  result = result && compare_image_values(dst->data, he_dst->data, height * width);
+
+  /* in place, same frame again reuses the table */
+  fill_image_values(he_dst, src->data, height * width);
+  result = result && (Image_Success == image_he_stream_frame(stream, he_dst, he_dst));
+  result = result && compare_image_values(dst->data, he_dst->data, height * width);
+
+  image_he_stream_destroy(&stream);
+  image_destroy(&src);
+  image_destroy(&dst);
+  image_destroy(&he_dst);
+  return result;
+}
+
+int test_image_he_stream_reuse(char *test_name) {
+  const size_t height = 8, width = 8;
+  int result;
+  image *src = NULL, *dst = NULL;
+  image_he_stream *stream = NULL;
+
+  unsigned char image_pixels_before_he[] = { 52, 55, 61, 59, 79, 61, 76, 61, 62, 59, 55, 104, 94, 85, 59, 71, 63, 65, 66, 113, 144, 104, 63, 72, 64, 70, 70, 126, 154, 109, 71, 69, 67, 73, 68, 106, 122, 88, 68, 68, 68, 79, 60, 70, 77, 66, 58, 75, 69, 85, 64, 58, 55, 61, 65, 83, 70, 87, 69, 68, 65, 73, 78, 90 };
+  unsigned char image_pixels_after_he[] = { 0, 12, 53, 32, 190, 53, 174, 53, 57, 32, 12, 227, 219, 202, 32, 154, 65, 85, 93, 239, 251, 227, 65, 158, 73, 146, 146, 247, 255, 235, 154, 130, 97, 166, 117, 231, 243, 210, 117, 117, 117, 190, 36, 146, 178, 93, 20, 170, 130, 202, 73, 20, 12, 53, 85, 194, 146, 206, 130, 117, 85, 166, 182, 215 };
+
+  strcpy(test_name, "test_image_he_stream_reuse");
+  if (NULL == (stream = image_he_stream_create(0.5, 0.1))) {
+    return 0;
+  }
+  src = image_create(height, width);
+  dst = image_create(height, width);
+  if (NULL == src || NULL == dst) {
+    image_he_stream_destroy(&stream);
+    image_destroy(&src);
+    image_destroy(&dst);
+    return 0;
+  }
+  fill_image_values(src, image_pixels_before_he, sizeof(image_pixels_before_he));
+  result = (Image_Success == image_he_stream_frame(stream, dst, src));
+
+  /* one pixel moved to another intensity (distance 2/64), first frame's table is kept */
+  src->data[0] = 90;
+  image_pixels_after_he[0] = 215;
+  result = result && (Image_Success == image_he_stream_frame(stream, dst, src));
+  result = result && compare_image_values(dst->data, image_pixels_after_he, sizeof(image_pixels_after_he));
+
+  image_he_stream_destroy(&stream);
+  image_destroy(&src);
+  image_destroy(&dst);
+  return result;
+}
+
+/* after a scene change the smoothed lut keeps moving on repeated frames until it matches image_he */
+int test_image_he_stream_smoothing(char *test_name) {
+  const size_t height = 16, width = 16, frames = 100;
+  size_t i, frame;
+  int result;
+  image *dark = NULL, *bright = NULL, *dst = NULL, *he_dst = NULL;
+  image_he_stream *stream = NULL;
+
+  strcpy(test_name, "test_image_he_stream_smoothing");
+  if (NULL == (stream = image_he_stream_create(0.9, 0.05))) {
+    return 0;
+  }
+  dark = image_create(height, width);
+  bright = image_create(height, width);
+  dst = image_create(height, width);
+  he_dst = image_create(height, width);
+  if (NULL == dark || NULL == bright || NULL == dst || NULL == he_dst) {
+    image_he_stream_destroy(&stream);
+    image_destroy(&dark);
+    image_destroy(&bright);
+    image_destroy(&dst);
+    image_destroy(&he_dst);
+    return 0;
+  }
+  for (i = 0 ; i < height * width ; ++i) {
+    dark->data[i] = i % 64;
+    bright->data[i] = 160 + (i * i) % 96;
+  }
+  result = (Image_Success == image_he(he_dst, bright));
+  result = result && (Image_Success == image_he_stream_frame(stream, dst, dark));
+
+  /* first bright frame is still blended with the dark one */
+  result = result && (Image_Success == image_he_stream_frame(stream, dst, bright));
+  result = result && !compare_image_values(dst->data, he_dst->data, height * width);
+  for (frame = 1 ; frame < frames && result ; ++frame) {
+    result = (Image_Success == image_he_stream_frame(stream, dst, bright));
+  }
+  result = result && compare_image_values(dst->data, he_dst->data, height * width);
+
+  image_he_stream_destroy(&stream);
+  image_destroy(&dark);
+  image_destroy(&bright);
+  image_destroy(&dst);
+  image_destroy(&he_dst);
+  return result;
+}
+
+int test_image_he_stream_null(char *test_name) {
+  const size_t height = 8, width = 8;
+  int result;
+  image *img = NULL;
+  image_he_stream *stream = NULL;
+
+  strcpy(test_name, "test_image_he_stream_null");
+  if (NULL != image_he_stream_create(1, 0) || NULL != image_he_stream_create(0, -1)) {
+    return 0;
+  }
+  if (NULL == (stream = image_he_stream_create(0, 0))) {
+    return 0;
+  }
+  if (NULL == (img = image_create(height, width))) {
+    image_he_stream_destroy(&stream);
+    return 0;
+  }
+  result = (Image_Uninitialized_Error == image_he_stream_frame(NULL, img, img));
+  result = result && (Image_Uninitialized_Error == image_he_stream_frame(stream, NULL, img));
+  result = result && (Image_Uninitialized_Error == image_he_stream_frame(stream, img, NULL));
+
+  image_he_stream_destroy(&stream);
+  image_destroy(&img);
+  return result;
+}
+
+
+/* image_resize Functions */
+
+int test_image_resize_identity(char *test_name) {
+  const size_t height = 7, width = 9;
+  Image_Filter filter;
+  image *src = NULL, *dst = NULL;
+
+  strcpy(test_name, "test_image_resize_identity");
+  if (NULL == (src = image_random_create(height, width))) {
+    return 0;
+  }
+  if (NULL == (dst = image_create(height, width))) {
+    image_destroy(&src);
+    return 0;
+  }
+  for (filter = Image_Filter_Nearest ; filter <= Image_Filter_Lanczos3 ; ++filter) {
+    if (Image_Success != image_resize(dst, src, filter) || 0 == compare_image_values(dst->data, src->data, height * width)) {
+      image_destroy(&src);
+      image_destroy(&dst);
+      return 0;
+    }
+  }
+  image_destroy(&src);
+  image_destroy(&dst);
+  return 1;
+}
+
+int test_image_resize_nearest(char *test_name) {
+  const size_t height = 2, width = 3;
+  image *src = NULL, *dst = NULL;
+
+  unsigned char image_values[] = { 1, 2, 3, 4, 5, 6 };
+  unsigned char image_after_resize[] = { 1, 1, 2, 2, 3, 3, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 4, 4, 5, 5, 6, 6 };
+
+  strcpy(test_name, "test_image_resize_nearest");
+  if (NULL == (src = image_create(height, width))) {
+    return 0;
+  }
+  if (NULL == (dst = image_create(height * 2, width * 2))) {
+    image_destroy(&src);
+    return 0;
+  }
+  fill_image_values(src, image_values, sizeof(image_values));
+
+  if (Image_Success != image_resize(dst, src, Image_Filter_Nearest)) {
+    image_destroy(&src);
+    image_destroy(&dst);
+    return 0;
+  }
+  if (0 == compare_image_values(dst->data, image_after_resize, sizeof(image_after_resize))) {
+    image_destroy(&src);
+    image_destroy(&dst);
+    return 0;
+  }
+  image_destroy(&src);
+  image_destroy(&dst);
+  return 1;
+}
+
+int test_image_resize_area(char *test_name) {
+  const size_t height = 4, width = 4;
+  image *src = NULL, *dst = NULL;
+
+  unsigned char image_values[] = { 10, 20, 100, 100, 30, 40, 0, 200, 0, 0, 255, 255, 2, 6, 255, 255 };
+  unsigned char image_after_resize[] = { 25, 100, 2, 255 };
+
+  strcpy(test_name, "test_image_resize_area");
+  if (NULL == (src = image_create(height, width))) {
+    return 0;
+  }
+  if (NULL == (dst = image_create(height / 2, width / 2))) {
+    image_destroy(&src);
+    return 0;
+  }
+  fill_image_values(src, image_values, sizeof(image_values));
+
+  if (Image_Success != image_resize(dst, src, Image_Filter_Area)) {
+    image_destroy(&src);
+    image_destroy(&dst);
+    return 0;
+  }
+  if (0 == compare_image_values(dst->data, image_after_resize, sizeof(image_after_resize))) {
+    image_destroy(&src);
+    image_destroy(&dst);
+    return 0;
+  }
+  image_destroy(&src);
+  image_destroy(&dst);
+  return 1;
+}
+
+/* large downscales of a constant image, horizontally and vertically, keep its value */
+int test_image_resize_flat(char *test_name) {
+  const size_t length = 40000;
+  const unsigned char value = 200;
+  Image_Filter filter;
+  image *row = NULL, *column = NULL, *dst = NULL;
+  int result = 1;
+
+  strcpy(test_name, "test_image_resize_flat");
+  row = image_create(1, length);
+  column = image_create(length, 1);
+  dst = image_create(1, 1);
+  if (NULL == row || NULL == column || NULL == dst) {
+    image_destroy(&row);
+    image_destroy(&column);
+    image_destroy(&dst);
+    return 0;
+  }
+  memset(row->data, value, length);
+  memset(column->data, value, length);
+  for (filter = Image_Filter_Nearest ; filter <= Image_Filter_Lanczos3 ; ++filter) {
+    result = result && (Image_Success == image_resize(dst, row, filter)) && (value == dst->data[0]);
+    result = result && (Image_Success == image_resize(dst, column, filter)) && (value == dst->data[0]);
+  }
+
+  image_destroy(&row);
+  image_destroy(&column);
+  image_destroy(&dst);
+  return result;
+}
+
+/* both passes share the weight tables, so a row and the same pixels as a column resize alike */
+int test_image_resize_transpose(char *test_name) {
+  const size_t src_lengths[] = { 31, 151 }, dst_lengths[] = { 45, 65 };
+  size_t size, i;
+  Image_Filter filter;
+  image *row = NULL, *column = NULL, *dst_row = NULL, *dst_column = NULL;
+  int result = 1;
+
+  strcpy(test_name, "test_image_resize_transpose");
+  for (size = 0 ; size < sizeof(src_lengths) / sizeof(src_lengths[0]) && result ; ++size) {
+    row = image_random_create(1, src_lengths[size]);
+    column = image_create(src_lengths[size], 1);
+    dst_row = image_create(1, dst_lengths[size]);
+    dst_column = image_create(dst_lengths[size], 1);
+    result = (NULL != row && NULL != column && NULL != dst_row && NULL != dst_column);
+    if (result) {
+      memcpy(column->data, row->data, src_lengths[size]);
+    }
+    for (filter = Image_Filter_Nearest ; filter <= Image_Filter_Lanczos3 && result ; ++filter) {
+      result = (Image_Success == image_resize(dst_row, row, filter)) && (Image_Success == image_resize(dst_column, column, filter));
+      for (i = 0 ; i < dst_lengths[size] && result ; ++i) {
+        result = (dst_row->data[i] == dst_column->data[i]);
+      }
+    }
+    image_destroy(&row);
+    image_destroy(&column);
+    image_destroy(&dst_row);
+    image_destroy(&dst_column);
+  }
+  return result;
+}
+
+int test_image_resize_plan(char *test_name) {
+  const size_t height = 16, width = 24;
+  int result;
+  image *src = NULL, *dst = NULL, *plan_dst = NULL;
+  image_resize_plan *plan = NULL;
+
+  strcpy(test_name, "test_image_resize_plan");
+  if (NULL != image_resize_plan_create(0, width, height, width, Image_Filter_Bilinear)) {
+    return 0;
+  }
+  if (NULL == (plan = image_resize_plan_create(height / 2, width / 3, height, width, Image_Filter_Lanczos3))) {
+    return 0;
+  }
+  src = image_random_create(height, width);
+  dst = image_create(height / 2, width / 3);
+  plan_dst = image_create(height / 2, width / 3);
+  if (NULL == src || NULL == dst || NULL == plan_dst) {
+    image_resize_plan_destroy(&plan);
+    image_destroy(&src);
+    image_destroy(&dst);
+    image_destroy(&plan_dst);
+    return 0;
+  }
+
+  /* cached plan gives same result as a one-off resize */
+  result = (Image_Success == image_resize_with_plan(plan_dst, src, plan));
+  result = result && (Image_Success == image_resize(dst, src, Image_Filter_Lanczos3));
+  result = result && compare_image_values(dst->data, plan_dst->data, (height / 2) * (width / 3));
+  result = result && (Image_Size_Error == image_resize_with_plan(src, src, plan));
+  result = result && (Image_Uninitialized_Error == image_resize_with_plan(dst, src, NULL));
+  result = result && (Image_Filter_Error == image_resize(dst, src, (Image_Filter)-1));
+
+  image_resize_plan_destroy(&plan);
+  image_destroy(&src);
+  image_destroy(&dst);
+  image_destroy(&plan_dst);
+  return result;
+}
+
+/* nearest only reads the sampled rows of the sparse source */
+int test_image_resize_4gpix(char *test_name) {
+  const size_t height = 98304, width = 65536;
+  image *src = NULL, *dst = NULL;
+  unsigned char image_after_resize[] = { 0, 0, 0, 77 };
+  int result;
+
+  strcpy(test_name, "test_image_resize_4gpix");
+  if (NULL == (src = image_mapped_create(height, width))) {
+    return 0;
+  }
+  if (NULL == (dst = image_create(2, 2))) {
+    image_mapped_destroy(&src);
+    return 0;
+  }
+  /* row 73728, col 49152 - sampled for dst (1, 1), past 4G */
+  src->data[73728 * width + 49152] = 77;
+
+  result = (Image_Success == image_resize(dst, src, Image_Filter_Nearest));
+  result = result && compare_image_values(dst->data, image_after_resize, sizeof(image_after_resize));
+
+  image_mapped_destroy(&src);
+  image_destroy(&dst);
+  return result;
+}
+
+
+/* High bit depth Functions */
+
+int test_min_max16(char *test_name) {
+  const size_t height = 3, width = 3;
+  unsigned short min, max;
+  unsigned short image_values[] = { 4095, 300, 65535, 1024, 7, 512, 4096, 256, 255 };
+  image16 *img = image16_create(height, width, 16);
+  strcpy(test_name, "test_min_max16");
+  if (NULL == img) {
+    return 0;
+  }
+  fill_image16_values(img, image_values, sizeof(image_values) / sizeof(image_values[0]));
+  if (Image_Success != image16_find_min_max(img, &min, &max)) {
+    image16_destroy(&img);
+    return 0;
+  }
+  image16_destroy(&img);
+  return (7 == min && 65535 == max);
+}
+
+int test_image16_histogram(char *test_name) {
+  const size_t height = 8, width = 8;
+  image16 *src = NULL, *dst = NULL;
+
+  /* Wikipedia's "Histogram equalization" values, as 12 bit (v * 16 + 3), spread over several histogram blocks */
+  unsigned short image_pixels_before_he[] = { 835, 883, 979, 947, 1267, 979, 1219, 979, 995, 947, 883, 1667, 1507, 1363, 947, 1139, 1011, 1043, 1059, 1811, 2307, 1667, 1011, 1155, 1027, 1123, 1123, 2019, 2467, 1747, 1139, 1107, 1075, 1171, 1091, 1699, 1955, 1411, 1091, 1091, 1091, 1267, 963, 1123, 1235, 1059, 931, 1203, 1107, 1363, 1027, 931, 883, 979, 1043, 1331, 1123, 1395, 1107, 1091, 1043, 1171, 1251, 1443 };
+  unsigned short image_pixels_after_he[] = { 0, 195, 845, 520, 3055, 845, 2795, 845, 910, 520, 195, 3640, 3510, 3250, 520, 2470, 1040, 1365, 1495, 3835, 4030, 3640, 1040, 2535, 1170, 2340, 2340, 3965, 4095, 3770, 2470, 2080, 1560, 2665, 1885, 3705, 3900, 3380, 1885, 1885, 1885, 3055, 585, 2340, 2860, 1495, 325, 2730, 2080, 3250, 1170, 325, 195, 845, 1365, 3120, 2340, 3315, 2080, 1885, 1365, 2665, 2925, 3445 };
+
+  strcpy(test_name, "test_image16_histogram");
+  if (NULL == (src = image16_create(height, width, 12))) {
+    return 0;
+  }
+  if (NULL == (dst = image16_create(height, width, 12))) {
+    image16_destroy(&src);
+    return 0;
+  }
+  fill_image16_values(src, image_pixels_before_he, height * width);
+  if (Image_Success != image16_he(dst, src)) {
+    image16_destroy(&src);
+    image16_destroy(&dst);
+    return 0;
+  }
+  if (0 == compare_image16_values(dst->data, image_pixels_after_he, height * width)) {
+    image16_destroy(&src);
+    image16_destroy(&dst);
+    return 0;
+  }
+  image16_destroy(&dst);
+  image16_destroy(&src);
+  return 1;
+}
+
+int test_image16_histogram_empty_blocks(char *test_name) {
+  const size_t height = 3, width = 3;
+  image16 *src = NULL, *dst = NULL;
+
+  /* only blocks 0, 1 and 255 are used - cdf(300) - cdf_min is 3 of 7 */
+  unsigned short image_pixels_before_he[] = { 0, 300, 65535, 300, 65535, 0, 65535, 300, 65535 };
+  unsigned short image_pixels_after_he[] = { 0, 28086, 65535, 28086, 65535, 0, 65535, 28086, 65535 };
+
+  strcpy(test_name, "test_image16_histogram_empty_blocks");
+  if (NULL == (src = image16_create(height, width, 16))) {
+    return 0;
+  }
+  if (NULL == (dst = image16_create(height, width, 16))) {
+    image16_destroy(&src);
+    return 0;
+  }
+  fill_image16_values(src, image_pixels_before_he, height * width);
+  if (Image_Success != image16_he(dst, src)) {
+    image16_destroy(&src);
+    image16_destroy(&dst);
+    return 0;
+  }
+  if (0 == compare_image16_values(dst->data, image_pixels_after_he, height * width)) {
+    image16_destroy(&src);
+    image16_destroy(&dst);
+    return 0;
+  }
+  image16_destroy(&dst);
+  image16_destroy(&src);
+  return 1;
+}
+
+int test_image16_histogram_bit_depth(char *test_name) {
+  const size_t height = 8, width = 8;
+  image16 *src = NULL, *dst = NULL;
+
+  strcpy(test_name, "test_image16_histogram_bit_depth");
+  if (NULL == (src = image16_create(height, width, 12))) {
+    return 0;
+  }
+  if (NULL == (dst = image16_create(height, width, 16))) {
+    image16_destroy(&src);
+    return 0;
+  }
+  if (Image_BitDepth_Error != image16_he(dst, src)) {
+    image16_destroy(&src);
+    image16_destroy(&dst);
+    return 0;
+  }
+  src->bit_depth = dst->bit_depth = 17;
+  if (Image_BitDepth_Error != image16_he(dst, src)) {
+    image16_destroy(&src);
+    image16_destroy(&dst);
+    return 0;
+  }
+  image16_destroy(&src);
+  image16_destroy(&dst);
+  return 1;
+}
+
+/* larger than one counting chunk - first half 0, second half one in four 300, the rest 65535 */
+int test_image16_histogram_chunks(char *test_name) {
+  const size_t height = 3000, width = 2000;
+  size_t i, size = height * width;
+  image16 *src = NULL, *dst = NULL;
+  int result = 1;
+
+  strcpy(test_name, "test_image16_histogram_chunks");
+  if (NULL == (src = image16_create(height, width, 16))) {
+    return 0;
+  }
+  if (NULL == (dst = image16_create(height, width, 16))) {
+    image16_destroy(&src);
+    return 0;
+  }
+  for (i = size / 2 ; i < size ; ++i) {
+    src->data[i] = (0 == i % 4) ? 300 : 65535;
+  }
+  if (Image_Success != image16_he(dst, src)) {
+    image16_destroy(&src);
+    image16_destroy(&dst);
+    return 0;
+  }
+  /* cdf(300) - cdf_min is a quarter of size - cdf_min */
+  for (i = 0 ; i < size && result ; ++i) {
+    result = (dst->data[i] == (i < size / 2 ? 0 : (0 == i % 4) ? 16384 : 65535));
+  }
+  image16_destroy(&src);
+  image16_destroy(&dst);
+  return result;
+}
+
+int test_image16_convolution_identity(char *test_name) {
+  const size_t height = 8, width = 8;
+  size_t i;
+  image16 *src = NULL, *dst = NULL;
+
+  unsigned short image_values[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, 52, 53, 54, 55, 56, 57, 58, 59, 60, 61, 62, 63, 64 };
+  unsigned short image_after_convolution[] = { 19, 19, 19, 20, 21, 22, 22, 22, 19, 19, 19, 20, 21, 22, 22, 22, 19, 19, 19, 20, 21, 22, 22, 22, 27, 27, 27, 28, 29, 30, 30, 30, 35, 35, 35, 36, 37, 38, 38, 38, 43, 43, 43, 44, 45, 46, 46, 46, 43, 43, 43, 44, 45, 46, 46, 46, 43, 43, 43, 44, 45, 46, 46, 46 };
+  double kernel[] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+
+  strcpy(test_name, "test_image16_convolution_identity");
+  /* scale to 16 bit values */
+  for (i = 0 ; i < height * width ; ++i) {
+    image_values[i] *= 1000;
+    image_after_convolution[i] *= 1000;
+  }
+  if (NULL == (src = image16_create(height, width, 16))) {
+    return 0;
+  }
+  if (NULL == (dst = image16_create(height, width, 16))) {
+    image16_destroy(&src);
+    return 0;
+  }
+  fill_image16_values(src, image_values, height * width);
+
+  if(Image_Success != image16_convolution(dst, src, kernel, 5)) {
+    image16_destroy(&src);
+    image16_destroy(&dst);
+    return 0;
+  }
+
+  if (0 == compare_image16_values(dst->data, image_after_convolution, height * width)) {
+    image16_destroy(&src);
+    image16_destroy(&dst);
+    return 0;
+  }
+  image16_destroy(&src);
+  image16_destroy(&dst);
+  return 1;
+}
+
+
 /* static function */
 
-static image* image_random_create(unsigned int height, unsigned int width) {
-  unsigned int i = 0, size = height * width;
+static image* image_random_create(size_t height, size_t width) {
+  size_t i = 0, size = height * width;
   image* img = NULL;
   if (size == 0) {
     return NULL;
@@ -436,7 +1089,7 @@ static image* image_random_create(unsigned int height, unsigned int width) {
   return img;
 }
 
-static image* image_create(unsigned int height, unsigned int width) {
+static image* image_create(size_t height, size_t width) {
   image *img = NULL;
   if (NULL == (img = (image*)malloc(sizeof(image)))) {
     return NULL;
@@ -459,6 +1112,33 @@ static void image_destroy(image **img) {
   *img = NULL;
 }
 
+/* zero filled anonymous mapping, pages are only backed once written */
+static image* image_mapped_create(size_t height, size_t width) {
+  image *img = NULL;
+  void *data;
+  if (NULL == (img = (image*)malloc(sizeof(image)))) {
+    return NULL;
+  }
+  data = mmap(NULL, height * width, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (MAP_FAILED == data) {
+    free(img);
+    return NULL;
+  }
+  img->data = (unsigned char*)data;
+  img->height = height;
+  img->width = width;
+  return img;
+}
+
+static void image_mapped_destroy(image **img) {
+  if (NULL == img || NULL == *img) {
+    return;
+  }
+  munmap((*img)->data, (*img)->height * (*img)->width);
+  free(*img);
+  *img = NULL;
+}
+
 static void fill_image_values(image *img, const unsigned char *values, size_t size) {
   size_t i = 0;
   if (NULL == img || NULL == values) {
@@ -489,3 +1169,47 @@ void print_image_data(const unsigned char *data, size_t height, size_t width) {
   }
   putchar('\n');
 }
+
+static image16* image16_create(size_t height, size_t width, int bit_depth) {
+  image16 *img = NULL;
+  if (NULL == (img = (image16*)malloc(sizeof(image16)))) {
+    return NULL;
+  }
+  if (NULL == (img->data = (unsigned short*)calloc(height * width, sizeof(unsigned short)))) {
+    free(img);
+    return NULL;
+  }
+  img->height = height;
+  img->width = width;
+  img->bit_depth = bit_depth;
+  return img;
+}
+
+static void image16_destroy(image16 **img) {
+  if (NULL == img || NULL == *img) {
+    return;
+  }
+  free((*img)->data);
+  free(*img);
+  *img = NULL;
+}
+
+static void fill_image16_values(image16 *img, const unsigned short *values, size_t size) {
+  size_t i = 0;
+  if (NULL == img || NULL == values) {
+    return;
+  }
+  for ( ; i < size ; ++i) {
+    img->data[i] = values[i];
+  }
+}
+
+static int compare_image16_values(const unsigned short *first, const unsigned short *second, size_t size) {
+  size_t i = 0;
+  for ( ; i < size ; ++i) {
+    if (first[i] != second[i]) {
+      return 0;
+    }
+  }
+  return 1;
+}